@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2013 Harm Hanemaaijer <fgenfb@yahoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * <string.h> is not included, so that memcpy can be defined as an alias of
+ * fastarm_adaptive_memcpy in the replacement library.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/auxv.h>
+
+#include "adaptive_memcpy.h"
+#include "new_arm.h"
+
+/*
+ * Size classes are < 16, < 64, < 256, < 1K, < 4K, < 16K, < 64K and >= 64K
+ * bytes.
+ */
+#define ADAPTIVE_NU_SIZE_CLASSES 8
+/* One in this many calls of a size class is sampled. */
+#define ADAPTIVE_SAMPLE_INTERVAL 64
+/* Number of most recent samples kept per size class. Must be a power of two. */
+#define ADAPTIVE_NU_SAMPLES 32
+/* Number of samples after which a size class is evaluated for the first time. */
+#define ADAPTIVE_FIRST_EVALUATION_INTERVAL 256
+/*
+ * The interval between evaluations doubles each time the variant in use
+ * remains the fastest, up to this number of samples.
+ */
+#define ADAPTIVE_MAX_EVALUATION_INTERVAL 65536
+/*
+ * A candidate replaces the variant in use only when it is faster by more
+ * than ADAPTIVE_HYSTERESIS_PERCENT in ADAPTIVE_CONFIRMATIONS consecutive
+ * evaluations, so that the choice does not oscillate between variants of
+ * similar speed.
+ */
+#define ADAPTIVE_HYSTERESIS_PERCENT 10
+#define ADAPTIVE_CONFIRMATIONS 2
+/* Samples larger than this size are replayed with this size. */
+#define ADAPTIVE_MAX_REPLAY_SIZE (64 * 1024)
+/* The samples are replayed until at least this many bytes have been copied. */
+#define ADAPTIVE_MIN_REPLAY_BYTES (64 * 1024)
+/*
+ * An evaluation runs inside the memcpy call that triggers it. To bound the
+ * stall, only the most recent samples that add up to at most this many bytes
+ * are replayed, which limits an evaluation to about 1 MB of copying
+ * (ADAPTIVE_REPLAY_ROUNDS replays with each of the candidates).
+ */
+#define ADAPTIVE_MAX_REPLAY_BYTES (112 * 1024)
+/* Number of timed replays of each candidate; the fastest one counts. */
+#define ADAPTIVE_REPLAY_ROUNDS 3
+/* Source and destination offsets of the samples are kept modulo this value. */
+#define ADAPTIVE_ALIGNMENT_MODULO 64
+
+#ifndef FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+#define FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+typedef void *(*fastarm_memcpy_func_type)(void *dest, const void *src, size_t n);
+#endif
+
+typedef struct {
+    const char *name;
+    fastarm_memcpy_func_type func;
+    int requires_neon;
+} candidate_t;
+
+enum {
+    CANDIDATE_JUMP_TABLE,
+    CANDIDATE_ARM,
+    CANDIDATE_NEON,
+    NU_CANDIDATES
+};
+
+static const candidate_t candidate[NU_CANDIDATES] = {
+    { "memcpy_new_line_size_32_preload_192_jump_table",
+        memcpy_new_line_size_32_preload_192_jump_table, 0 },
+    { "memcpy_new_line_size_32_preload_192", memcpy_new_line_size_32_preload_192, 0 },
+    { "memcpy_new_neon_line_size_32", memcpy_new_neon_line_size_32, 1 },
+};
+
+typedef struct {
+    uint32_t size;
+    uint8_t dest_offset;
+    uint8_t src_offset;
+} sample_t;
+
+typedef struct {
+    sample_t sample[ADAPTIVE_NU_SAMPLES];
+    uint32_t nu_samples;
+    uint32_t next_evaluation;
+    uint32_t evaluation_interval;
+    int current;
+    /* Candidate that was faster in the last evaluation, or -1. */
+    int challenger;
+    int confirmations;
+} size_class_state_t;
+
+typedef struct {
+    size_class_state_t size_class[ADAPTIVE_NU_SIZE_CLASSES];
+    int evaluating;
+} thread_state_t;
+
+/*
+ * The function table and sample countdowns used by the fast path are kept in
+ * thread-local storage; the sample state is allocated when a thread first
+ * samples. The initial-exec model avoids a call to __tls_get_addr, and is
+ * suitable because the library is loaded at program start.
+ */
+#define ADAPTIVE_TLS __thread __attribute__((tls_model("initial-exec")))
+
+/*
+ * Until the sample state of a thread has been created, copies use the plain
+ * ARM variant (memcpy itself may be this function in libfastarm.so). This
+ * covers copies made by calloc() while the state is being created.
+ */
+static ADAPTIVE_TLS fastarm_memcpy_func_type thread_func[ADAPTIVE_NU_SIZE_CLASSES] = {
+    [0 ... ADAPTIVE_NU_SIZE_CLASSES - 1] = memcpy_new_line_size_32_preload_192
+};
+static ADAPTIVE_TLS int thread_countdown[ADAPTIVE_NU_SIZE_CLASSES];
+static ADAPTIVE_TLS thread_state_t *thread_state;
+static ADAPTIVE_TLS int thread_creating_state;
+
+static struct {
+    pthread_once_t once;
+    pthread_key_t state_key;
+    int has_neon;
+    /* Scratch buffer for the replays, shared by all threads. */
+    pthread_mutex_t scratch_mutex;
+    uint8_t *scratch;
+} adaptive = { .once = PTHREAD_ONCE_INIT, .scratch_mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static inline int size_class(size_t n) {
+    int b = sizeof(unsigned long) * 8 - 1 - __builtin_clzl((unsigned long)n | 15);
+    int c = (b - 2) >> 1;
+    return c < ADAPTIVE_NU_SIZE_CLASSES - 1 ? c : ADAPTIVE_NU_SIZE_CLASSES - 1;
+}
+
+static int default_candidate(int c) {
+    if (c <= 1)
+        return CANDIDATE_JUMP_TABLE;
+    return adaptive.has_neon ? CANDIDATE_NEON : CANDIDATE_ARM;
+}
+
+static int64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void free_thread_state(void *arg) {
+    /* Stop sampling in the exiting thread. */
+    for (int c = 0; c < ADAPTIVE_NU_SIZE_CLASSES; c++)
+        thread_countdown[c] = INT32_MAX;
+    thread_state = NULL;
+    free(arg);
+}
+
+static void init_adaptive() {
+#if defined(__arm__) && defined(HWCAP_ARM_NEON)
+    adaptive.has_neon = (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) != 0;
+#endif
+    pthread_key_create(&adaptive.state_key, free_thread_state);
+}
+
+static thread_state_t *create_thread_state() {
+    pthread_once(&adaptive.once, init_adaptive);
+    thread_state_t *state = calloc(1, sizeof(thread_state_t));
+    if (state == NULL)
+        return NULL;
+    for (int c = 0; c < ADAPTIVE_NU_SIZE_CLASSES; c++) {
+        size_class_state_t *s = &state->size_class[c];
+        s->current = default_candidate(c);
+        s->challenger = - 1;
+        s->evaluation_interval = ADAPTIVE_FIRST_EVALUATION_INTERVAL;
+        s->next_evaluation = ADAPTIVE_FIRST_EVALUATION_INTERVAL;
+        thread_func[c] = candidate[s->current].func;
+    }
+    pthread_setspecific(adaptive.state_key, state);
+    thread_state = state;
+    return state;
+}
+
+/*
+ * Return the time in ns of the fastest of ADAPTIVE_REPLAY_ROUNDS replays of
+ * the samples with func.
+ */
+static int64_t replay(fastarm_memcpy_func_type func, const sample_t *sample, int nu_samples) {
+    uint8_t *src_base = adaptive.scratch;
+    uint8_t *dest_base = adaptive.scratch + ADAPTIVE_MAX_REPLAY_SIZE + ADAPTIVE_ALIGNMENT_MODULO;
+    size_t bytes = 0;
+    for (int i = 0; i < nu_samples; i++)
+        bytes += sample[i].size;
+    int repeat = bytes < ADAPTIVE_MIN_REPLAY_BYTES ? ADAPTIVE_MIN_REPLAY_BYTES / (bytes + 1) + 1 : 1;
+    int64_t best = INT64_MAX;
+    for (int round = 0; round < ADAPTIVE_REPLAY_ROUNDS; round++) {
+        int64_t start_time = get_time_ns();
+        for (int r = 0; r < repeat; r++)
+            for (int i = 0; i < nu_samples; i++)
+                func(dest_base + sample[i].dest_offset, src_base + sample[i].src_offset,
+                    sample[i].size);
+        int64_t t = get_time_ns() - start_time;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* Benchmark the candidates on the samples of size class c. */
+static void evaluate(thread_state_t *state, int c) {
+    size_class_state_t *s = &state->size_class[c];
+    if (pthread_mutex_trylock(&adaptive.scratch_mutex) != 0) {
+        /* Another thread is evaluating; try again a little later. */
+        s->next_evaluation = s->nu_samples + ADAPTIVE_NU_SAMPLES;
+        return;
+    }
+    if (adaptive.scratch == NULL && posix_memalign((void **)&adaptive.scratch,
+    ADAPTIVE_ALIGNMENT_MODULO, 2 * (ADAPTIVE_MAX_REPLAY_SIZE + ADAPTIVE_ALIGNMENT_MODULO)) != 0) {
+        adaptive.scratch = NULL;
+        pthread_mutex_unlock(&adaptive.scratch_mutex);
+        s->next_evaluation = UINT32_MAX;
+        return;
+    }
+    state->evaluating = 1;
+    int n = s->nu_samples < ADAPTIVE_NU_SAMPLES ? s->nu_samples : ADAPTIVE_NU_SAMPLES;
+    sample_t sample[ADAPTIVE_NU_SAMPLES];
+    int nu_samples = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++) {
+        const sample_t *p = &s->sample[(s->nu_samples - 1 - i) & (ADAPTIVE_NU_SAMPLES - 1)];
+        if (nu_samples > 0 && bytes + p->size > ADAPTIVE_MAX_REPLAY_BYTES)
+            break;
+        sample[nu_samples++] = *p;
+        bytes += p->size;
+    }
+    int best = - 1;
+    int64_t best_time = 0, current_time = 0;
+    for (int k = 0; k < NU_CANDIDATES; k++) {
+        if (candidate[k].requires_neon && !adaptive.has_neon)
+            continue;
+        int64_t t = replay(candidate[k].func, sample, nu_samples);
+        if (k == s->current)
+            current_time = t;
+        if (best < 0 || t < best_time) {
+            best = k;
+            best_time = t;
+        }
+    }
+    state->evaluating = 0;
+    pthread_mutex_unlock(&adaptive.scratch_mutex);
+    if (best != s->current && best_time * 100 < current_time * (100 - ADAPTIVE_HYSTERESIS_PERCENT)) {
+        if (best == s->challenger)
+            s->confirmations++;
+        else {
+            s->challenger = best;
+            s->confirmations = 1;
+        }
+        if (s->confirmations >= ADAPTIVE_CONFIRMATIONS) {
+            s->current = best;
+            s->challenger = - 1;
+            thread_func[c] = candidate[best].func;
+        }
+    }
+    else {
+        s->challenger = - 1;
+        if (s->evaluation_interval < ADAPTIVE_MAX_EVALUATION_INTERVAL)
+            s->evaluation_interval *= 2;
+    }
+    s->next_evaluation = s->nu_samples + s->evaluation_interval;
+}
+
+static void *sample_and_copy(void *dest, const void *src, size_t n, int c) {
+    thread_countdown[c] = ADAPTIVE_SAMPLE_INTERVAL - 1;
+    thread_state_t *state = thread_state;
+    if (state == NULL) {
+        /* Re-entered from calloc() in create_thread_state(). */
+        if (thread_creating_state)
+            return thread_func[c](dest, src, n);
+        thread_creating_state = 1;
+        state = create_thread_state();
+        thread_creating_state = 0;
+        if (state == NULL) {
+            thread_func[c] = candidate[CANDIDATE_ARM].func;
+            thread_countdown[c] = INT32_MAX;
+            return thread_func[c](dest, src, n);
+        }
+    }
+    /* Copies performed by the evaluation itself are not sampled. */
+    if (!state->evaluating) {
+        size_class_state_t *s = &state->size_class[c];
+        sample_t *p = &s->sample[s->nu_samples & (ADAPTIVE_NU_SAMPLES - 1)];
+        p->size = n < ADAPTIVE_MAX_REPLAY_SIZE ? n : ADAPTIVE_MAX_REPLAY_SIZE;
+        p->dest_offset = (uintptr_t)dest & (ADAPTIVE_ALIGNMENT_MODULO - 1);
+        p->src_offset = (uintptr_t)src & (ADAPTIVE_ALIGNMENT_MODULO - 1);
+        s->nu_samples++;
+        if (s->nu_samples >= s->next_evaluation)
+            evaluate(state, c);
+    }
+    return thread_func[c](dest, src, n);
+}
+
+void *fastarm_adaptive_memcpy(void *dest, const void *src, size_t n) {
+    int c = size_class(n);
+    if (__builtin_expect(--thread_countdown[c] < 0, 0))
+        return sample_and_copy(dest, src, n, c);
+    return thread_func[c](dest, src, n);
+}
+
+const char *fastarm_adaptive_variant_name(size_t n) {
+    int c = size_class(n);
+    if (thread_state != NULL)
+        return candidate[thread_state->size_class[c].current].name;
+    pthread_once(&adaptive.once, init_adaptive);
+    return candidate[default_candidate(c)].name;
+}
+
+#ifdef MEMCPY_REPLACEMENT_ADAPTIVE
+void *memcpy(void *dest, const void *src, size_t n) __attribute__((alias("fastarm_adaptive_memcpy")));
+
+/*
+ * The run-time ABI, fortified and GNU entry points. These are provided by
+ * new_arm.S for the other platforms. The word aligned AEABI forms have no
+ * dedicated path here, because the size class alone selects the variant.
+ */
+void *__aeabi_memcpy(void *dest, const void *src, size_t n) __attribute__((alias("fastarm_adaptive_memcpy")));
+void *__aeabi_memcpy4(void *dest, const void *src, size_t n) __attribute__((alias("fastarm_adaptive_memcpy")));
+void *__aeabi_memcpy8(void *dest, const void *src, size_t n) __attribute__((alias("fastarm_adaptive_memcpy")));
+
+extern void __chk_fail(void) __attribute__((noreturn));
+
+void *__memcpy_chk(void *dest, const void *src, size_t n, size_t destlen) {
+    if (destlen < n)
+        __chk_fail();
+    return fastarm_adaptive_memcpy(dest, src, n);
+}
+
+void *mempcpy(void *dest, const void *src, size_t n) {
+    return (uint8_t *)fastarm_adaptive_memcpy(dest, src, n) + n;
+}
+#endif
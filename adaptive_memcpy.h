@@ -0,0 +1,25 @@
+/*
+ * Adaptive memcpy.
+ *
+ * Calls are divided into size classes. Each thread samples the size and
+ * alignment of a small fraction of its calls and periodically benchmarks the
+ * candidate variants on the recorded samples of a size class, switching the
+ * variant used for that size class in its per-size-class function table
+ * when a candidate is consistently faster. When libfastarm.so is built with
+ * PLATFORM = ADAPTIVE, memcpy is replaced by fastarm_adaptive_memcpy.
+ */
+
+#ifndef ADAPTIVE_MEMCPY_H
+#define ADAPTIVE_MEMCPY_H
+
+#include <stddef.h>
+
+extern void *fastarm_adaptive_memcpy(void *dest, const void *src, size_t n);
+
+/*
+ * Return the name of the variant currently used by the calling thread for
+ * copies of size n.
+ */
+extern const char *fastarm_adaptive_variant_name(size_t n);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2013 Harm Hanemaaijer <fgenfb@yahoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "async_memcpy.h"
+
+/* Number of entries in each submission ring. Must be a power of two. */
+#define ASYNC_RING_SIZE 256
+/*
+ * Requests smaller than this size that are adjacent in both source and
+ * destination to the previous request are combined into a single copy.
+ */
+#define ASYNC_BATCH_THRESHOLD 256
+/* Upper limit on the size of a combined copy. */
+#define ASYNC_BATCH_MAX_SIZE 4096
+/* Number of idle polling rounds before the worker goes to sleep. */
+#define ASYNC_IDLE_SPIN_COUNT 4096
+/* Keep the producer and consumer indices in different cache lines. */
+#define ASYNC_CACHE_LINE_SIZE 64
+
+typedef struct {
+    void *dest;
+    const void *src;
+    size_t n;
+} async_request_t;
+
+typedef struct async_ring {
+    async_request_t request[ASYNC_RING_SIZE];
+    /* Written by the submitting thread only. */
+    uint32_t head __attribute__((aligned(ASYNC_CACHE_LINE_SIZE)));
+    /* Written by the worker only; equal to the number of completed requests. */
+    uint32_t tail __attribute__((aligned(ASYNC_CACHE_LINE_SIZE)));
+    /*
+     * Set by the owning thread while it decides whether to queue a request,
+     * so that the shutdown can wait until no more requests are queued.
+     */
+    int submitting;
+    /* Set when the owning thread has exited and the ring may be reused. */
+    int unused __attribute__((aligned(ASYNC_CACHE_LINE_SIZE)));
+    struct async_ring *next;
+} async_ring_t;
+
+/*
+ * running is set while a worker exists; after it is cleared, copies are
+ * performed synchronously by the submitting thread, which is then the only
+ * writer of its ring. closing is set at the start of the shutdown; from then
+ * on no new requests are queued, and stop tells the worker to exit once all
+ * rings are empty.
+ */
+static struct {
+    pthread_t thread;
+    int running;
+    int closing;
+    int stop;
+    int sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_key_t ring_key;
+    pthread_once_t ring_key_once;
+    async_ring_t *rings;
+    fastarm_memcpy_func_type copy_func;
+    int cpu;
+} engine = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+    .ring_key_once = PTHREAD_ONCE_INIT, .copy_func = memcpy };
+
+static __thread async_ring_t *thread_ring;
+
+/* Wrap-around safe comparison of sequence numbers. */
+static inline int sequence_reached(uint32_t current, uint32_t target) {
+    return (int32_t)(current - target) >= 0;
+}
+
+/*
+ * Process the pending requests of a ring, combining adjacent small requests.
+ * Returns the number of requests completed.
+ */
+static int process_ring(async_ring_t *ring) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int count = 0;
+    while (tail != head) {
+        async_request_t *r = &ring->request[tail & (ASYNC_RING_SIZE - 1)];
+        uint8_t *dest = r->dest;
+        const uint8_t *src = r->src;
+        size_t n = r->n;
+        tail++;
+        while (tail != head && n < ASYNC_BATCH_MAX_SIZE) {
+            async_request_t *next = &ring->request[tail & (ASYNC_RING_SIZE - 1)];
+            if (next->n >= ASYNC_BATCH_THRESHOLD || next->dest != dest + n ||
+            next->src != src + n || n + next->n > ASYNC_BATCH_MAX_SIZE)
+                break;
+            n += next->n;
+            tail++;
+        }
+        engine.copy_func(dest, src, n);
+        /* Publish the completion of the request(s). */
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        count++;
+    }
+    return count;
+}
+
+/* Returns 1 when a ring has queued requests that have not been completed. */
+static int requests_pending() {
+    async_ring_t *ring = __atomic_load_n(&engine.rings, __ATOMIC_ACQUIRE);
+    for (; ring != NULL; ring = ring->next)
+        if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail)
+            return 1;
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    if (engine.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(engine.cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    int idle = 0;
+    for (;;) {
+        int count = 0;
+        async_ring_t *ring = __atomic_load_n(&engine.rings, __ATOMIC_ACQUIRE);
+        for (; ring != NULL; ring = ring->next)
+            count += process_ring(ring);
+        if (count > 0) {
+            idle = 0;
+            continue;
+        }
+        /*
+         * No requests are queued after stop has been set, so the rings are
+         * drained once they are all found empty.
+         */
+        if (__atomic_load_n(&engine.stop, __ATOMIC_SEQ_CST) && !requests_pending())
+            break;
+        idle++;
+        if (idle < ASYNC_IDLE_SPIN_COUNT)
+            continue;
+        /*
+         * Go to sleep. The sleeping flag is set before the rings are checked
+         * for a final time, so that a submitter that publishes a request
+         * after that check is guaranteed to see the flag and wake us up.
+         */
+        pthread_mutex_lock(&engine.mutex);
+        __atomic_store_n(&engine.sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!requests_pending() && !__atomic_load_n(&engine.stop, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&engine.cond, &engine.mutex);
+        __atomic_store_n(&engine.sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&engine.mutex);
+        idle = 0;
+    }
+    return NULL;
+}
+
+static void wake_worker() {
+    pthread_mutex_lock(&engine.mutex);
+    pthread_cond_signal(&engine.cond);
+    pthread_mutex_unlock(&engine.mutex);
+}
+
+/* Called when a thread that owns a ring exits. */
+static void release_ring(void *arg) {
+    async_ring_t *ring = arg;
+    while (!sequence_reached(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), ring->head))
+        sched_yield();
+    __atomic_store_n(&ring->unused, 1, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key() {
+    pthread_key_create(&engine.ring_key, release_ring);
+}
+
+static async_ring_t *get_thread_ring() {
+    if (thread_ring != NULL)
+        return thread_ring;
+    pthread_once(&engine.ring_key_once, create_ring_key);
+    async_ring_t *ring;
+    /* Reuse the ring of a thread that has exited, if possible. */
+    for (ring = __atomic_load_n(&engine.rings, __ATOMIC_ACQUIRE); ring != NULL;
+    ring = ring->next) {
+        int unused = 1;
+        if (__atomic_compare_exchange_n(&ring->unused, &unused, 0, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (ring == NULL) {
+        if (posix_memalign((void **)&ring, ASYNC_CACHE_LINE_SIZE, sizeof(async_ring_t)) != 0)
+            abort();
+        memset(ring, 0, sizeof(async_ring_t));
+        /*
+         * Rings are never removed from the list, so a simple push suffices.
+         * The push is sequentially consistent so that a shutdown that does
+         * not see the ring is seen by its first submission.
+         */
+        ring->next = __atomic_load_n(&engine.rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&engine.rings, &ring->next, ring, 1,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(engine.ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+int fastarm_async_init(int cpu, fastarm_memcpy_func_type copy_func) {
+    if (__atomic_load_n(&engine.running, __ATOMIC_ACQUIRE))
+        return - 1;
+    engine.copy_func = copy_func != NULL ? copy_func : memcpy;
+    engine.cpu = cpu;
+    engine.stop = 0;
+    engine.sleeping = 0;
+    if (pthread_create(&engine.thread, NULL, worker_main, NULL) != 0)
+        return - 1;
+    __atomic_store_n(&engine.closing, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&engine.running, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+void fastarm_async_shutdown(void) {
+    if (!__atomic_load_n(&engine.running, __ATOMIC_ACQUIRE))
+        return;
+    /*
+     * Stop queueing requests and wait for submissions that are in progress.
+     * A submitter sets its submitting flag before it checks closing, so it
+     * either sees closing or is waited for here.
+     */
+    __atomic_store_n(&engine.closing, 1, __ATOMIC_SEQ_CST);
+    async_ring_t *ring;
+    for (ring = __atomic_load_n(&engine.rings, __ATOMIC_SEQ_CST); ring != NULL;
+    ring = ring->next)
+        while (__atomic_load_n(&ring->submitting, __ATOMIC_SEQ_CST))
+            sched_yield();
+    /* The worker drains all rings before it exits. */
+    __atomic_store_n(&engine.stop, 1, __ATOMIC_SEQ_CST);
+    wake_worker();
+    pthread_join(engine.thread, NULL);
+    __atomic_store_n(&engine.running, 0, __ATOMIC_RELEASE);
+}
+
+fastarm_async_token_t fastarm_async_memcpy(void *dest, const void *src, size_t n) {
+    async_ring_t *ring = get_thread_ring();
+    uint32_t head = ring->head;
+    __atomic_store_n(&ring->submitting, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&engine.running, __ATOMIC_SEQ_CST) ||
+    __atomic_load_n(&engine.closing, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&ring->submitting, 0, __ATOMIC_RELEASE);
+        /*
+         * No worker, or it is shutting down; wait until it has drained the
+         * rings and perform the copy synchronously.
+         */
+        while (__atomic_load_n(&engine.running, __ATOMIC_ACQUIRE))
+            sched_yield();
+        engine.copy_func(dest, src, n);
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->tail, head + 1, __ATOMIC_RELEASE);
+        return head + 1;
+    }
+    /* Wait for a free slot when the ring is full. */
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ASYNC_RING_SIZE) {
+        if (__atomic_load_n(&engine.sleeping, __ATOMIC_SEQ_CST))
+            wake_worker();
+        sched_yield();
+    }
+    async_request_t *r = &ring->request[head & (ASYNC_RING_SIZE - 1)];
+    r->dest = dest;
+    r->src = src;
+    r->n = n;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->submitting, 0, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&engine.sleeping, __ATOMIC_SEQ_CST))
+        wake_worker();
+    return head + 1;
+}
+
+int fastarm_async_poll(fastarm_async_token_t token) {
+    async_ring_t *ring = get_thread_ring();
+    return sequence_reached(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), token);
+}
+
+void fastarm_async_wait(fastarm_async_token_t token) {
+    async_ring_t *ring = get_thread_ring();
+    int spin = 0;
+    while (!sequence_reached(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), token)) {
+        spin++;
+        if (spin >= ASYNC_IDLE_SPIN_COUNT) {
+            if (__atomic_load_n(&engine.sleeping, __ATOMIC_SEQ_CST))
+                wake_worker();
+            sched_yield();
+        }
+    }
+}
+
+void fastarm_async_wait_all(void) {
+    async_ring_t *ring = get_thread_ring();
+    fastarm_async_wait(ring->head);
+}
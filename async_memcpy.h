@@ -0,0 +1,54 @@
+/*
+ * Asynchronous memcpy engine.
+ *
+ * Copies are submitted to a lock-free single-producer/single-consumer ring
+ * owned by the submitting thread and performed by a dedicated (optionally
+ * pinned) copy worker thread. Each submission returns a completion token
+ * that can be polled or waited upon by the submitting thread.
+ */
+
+#ifndef ASYNC_MEMCPY_H
+#define ASYNC_MEMCPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+#define FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+typedef void *(*fastarm_memcpy_func_type)(void *dest, const void *src, size_t n);
+#endif
+
+typedef uint32_t fastarm_async_token_t;
+
+/*
+ * Start the copy worker. cpu is the core the worker is pinned to, or -1 for
+ * no pinning. copy_func is the memcpy implementation used by the worker; when
+ * NULL, memcpy is used (which is the tuned variant when libfastarm.so is
+ * active). Must not be called while other threads submit copies. Returns 0
+ * on success.
+ */
+extern int fastarm_async_init(int cpu, fastarm_memcpy_func_type copy_func);
+
+/*
+ * Wait for all outstanding copies and stop the copy worker. Copies submitted
+ * during and after the shutdown are performed synchronously.
+ */
+extern void fastarm_async_shutdown(void);
+
+/*
+ * Submit a copy. The source and destination must not be touched by the
+ * caller until the copy has completed. Adjacent small requests submitted back
+ * to back may be combined into a single copy by the worker.
+ */
+extern fastarm_async_token_t fastarm_async_memcpy(void *dest, const void *src, size_t n);
+
+/* Returns 1 when the copy identified by token has completed, 0 otherwise. */
+extern int fastarm_async_poll(fastarm_async_token_t token);
+
+/* Wait until the copy identified by token has completed. */
+extern void fastarm_async_wait(fastarm_async_token_t token);
+
+/* Wait until all copies submitted by the calling thread have completed. */
+extern void fastarm_async_wait_all(void);
+
+#endif
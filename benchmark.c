@@ -22,18 +22,31 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <ctype.h>
 #include <time.h>
 #include <sys/time.h>
 #include <math.h>
+#include <wchar.h>
+#include <sched.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include "arm_asm.h"
 #include "new_arm.h"
+#include "adaptive_memcpy.h"
+#include "async_memcpy.h"
+#include "memcpy_batch.h"
+#include "file_copy.h"
 #ifdef INCLUDE_MEMCPY_HYBRID
 #include "memcpy-hybrid.h"
 #endif
@@ -56,8 +69,13 @@ void *armmem_memcpy(void * restrict s1, const void * restrict s2, size_t n);
 #define MEMCPY_HYBRID_COUNT 0
 #endif
 
-#define NU_MEMCPY_VARIANTS (57 + LIBARMMEM_COUNT + MEMCPY_HYBRID_COUNT)
-#define NU_MEMSET_VARIANTS 5
+#define NU_BUILTIN_MEMCPY_VARIANTS (69 + LIBARMMEM_COUNT + MEMCPY_HYBRID_COUNT)
+#define NU_BUILTIN_MEMSET_VARIANTS 10
+/* Maximum number of variants loaded from shared objects with --load. */
+#define MAX_LOADED_VARIANTS 32
+/* Room for the other instruction set encoding of each built-in variant. */
+#define MAX_MEMCPY_VARIANTS (2 * NU_BUILTIN_MEMCPY_VARIANTS + MAX_LOADED_VARIANTS)
+#define MAX_MEMSET_VARIANTS (2 * NU_BUILTIN_MEMSET_VARIANTS + MAX_LOADED_VARIANTS)
 
 
 typedef void *(*memcpy_func_type)(void *dest, const void *src, size_t n);
@@ -69,11 +87,17 @@ uint8_t *buffer_alloc, *buffer_chunk, *buffer_page, *buffer_compare;
 int *random_buffer_1024, *random_buffer_1M, *random_buffer_powers_of_two_up_to_4096_power_law;
 int *random_buffer_multiples_of_four_up_to_1024_power_law, *random_buffer_up_to_1023_power_law;
 double test_duration = DEFAULT_TEST_DURATION;
-int memcpy_mask[NU_MEMCPY_VARIANTS];
-int memset_mask[NU_MEMSET_VARIANTS];
+int cache_flush_size = 32 * 1024 * 1024;
+int nu_memcpy_variants = NU_BUILTIN_MEMCPY_VARIANTS;
+int nu_memset_variants = NU_BUILTIN_MEMSET_VARIANTS;
+int memcpy_mask[MAX_MEMCPY_VARIANTS];
+int memset_mask[MAX_MEMSET_VARIANTS];
 int test_alignment;
+int interleave;
+int benchmark_cpu = - 1;
+int cold_icache;
 
-static const char *memcpy_variant_name[NU_MEMCPY_VARIANTS] = {
+static const char *memcpy_variant_name[MAX_MEMCPY_VARIANTS] = {
     "standard memcpy",
 #ifdef INCLUDE_LIBARMMEM_MEMCPY
     "libarmmem memcpy",
@@ -136,10 +160,22 @@ static const char *memcpy_variant_name[NU_MEMCPY_VARIANTS] = {
     "armv5te non-overfetching memcpy with line size of 64, write alignment of 64 and block write size of 32, preload offset 256 with early preload",
     "armv5te non-overfetching memcpy with line_size of 64, write alignment of 64 and block write size of 32, preload offset 320 with early preload",
     "armv5te overfetching memcpy with write alignment of 16 and block write size of 16, preload offset 128 with early preload",
-    "armv5te overfetching memcpy with write alignment of 32 and block write size of 32, preload offset 192 with early preload"
+    "armv5te overfetching memcpy with write alignment of 32 and block write size of 32, preload offset 192 with early preload",
+    "new memcpy for cortex with line size of 64, preload offset of 192, small size jump table",
+    "new memcpy for cortex with line size of 32, preload offset of 192, small size jump table",
+    "new memcpy for rpi with preload offset of 96, write alignment of 8, small size jump table",
+    "new memcpy for rpi with preload offset of 96, write alignment of 8, aligned access, small size jump table",
+    "memcpy with 16-byte alignment contract (fastarm_memcpy_aligned16)",
+    "memcpy with 32-byte alignment contract (fastarm_memcpy_aligned32)",
+    "memcpy with 64-byte alignment contract (fastarm_memcpy_aligned64)",
+    "new memcpy for cortex with line size of 64, preload offset of 192, write preload offset of 128 (PLDW)",
+    "new memcpy for cortex with line size of 32, preload offset of 192, write preload offset of 128 (PLDW)",
+    "new memcpy for cortex using NEON with line size 64, preload offset 192, write preload offset 128 (PLDW)",
+    "new memcpy for cortex using NEON with line size 32, preload offset 192, write preload offset 128 (PLDW)",
+    "adaptive memcpy choosing between variants per size class at run time"
 };
 
-static const memcpy_func_type memcpy_variant[NU_MEMCPY_VARIANTS] = {
+static memcpy_func_type memcpy_variant[MAX_MEMCPY_VARIANTS] = {
     memcpy,
 #ifdef INCLUDE_LIBARMMEM_MEMCPY
     armmem_memcpy,
@@ -202,25 +238,146 @@ static const memcpy_func_type memcpy_variant[NU_MEMCPY_VARIANTS] = {
     memcpy_armv5te_no_overfetch_line_64_align_64_block_write_32_preload_early_256,
     memcpy_armv5te_no_overfetch_line_64_align_64_block_write_32_preload_early_320,
     memcpy_armv5te_overfetch_align_16_block_write_16_preload_early_128,
-    memcpy_armv5te_overfetch_align_32_block_write_32_preload_early_192
+    memcpy_armv5te_overfetch_align_32_block_write_32_preload_early_192,
+    memcpy_new_line_size_64_preload_192_jump_table,
+    memcpy_new_line_size_32_preload_192_jump_table,
+    memcpy_new_line_size_32_preload_96_jump_table,
+    memcpy_new_line_size_32_preload_96_aligned_access_jump_table,
+    fastarm_memcpy_aligned16,
+    fastarm_memcpy_aligned32,
+    fastarm_memcpy_aligned64,
+    memcpy_new_line_size_64_preload_192_pldw_128,
+    memcpy_new_line_size_32_preload_192_pldw_128,
+    memcpy_new_neon_line_size_64_pldw_128,
+    memcpy_new_neon_line_size_32_pldw_128,
+    fastarm_adaptive_memcpy
 };
 
-static const char *memset_variant_name[NU_MEMSET_VARIANTS] = {
+static const char *memset_variant_name[MAX_MEMSET_VARIANTS] = {
     "libc memset",
     "optimized memset with write alignment of 0",
     "optimized memset with write alignment of 8",
     "optimized memset with write alignment of 32",
     "NEON memset",
+    "memset with 16-byte alignment contract (fastarm_memset_aligned16)",
+    "memset with 32-byte alignment contract (fastarm_memset_aligned32)",
+    "memset with 64-byte alignment contract (fastarm_memset_aligned64)",
+    "optimized memset with write alignment of 32, write preload offset of 128 (PLDW)",
+    "NEON memset with write preload offset of 128 (PLDW)"
 };
 
-static const memset_func_type memset_variant[NU_MEMSET_VARIANTS] = {
+static memset_func_type memset_variant[MAX_MEMSET_VARIANTS] = {
     memset,
     memset_new_align_0,
     memset_new_align_8,
     memset_new_align_32,
-    memset_neon
+    memset_neon,
+    fastarm_memset_aligned16,
+    fastarm_memset_aligned32,
+    fastarm_memset_aligned64,
+    memset_new_align_32_pldw_128,
+    memset_neon_pldw_128
 };
 
+/*
+ * The assembler variants are also built in the other instruction set (ARM or
+ * Thumb2) with the mode appended to their symbols (see the Makefile).
+ * --both-modes adds these encodings as variants, each of which is recorded
+ * here with the built-in variant it was derived from.
+ */
+
+typedef struct {
+    int is_memset;
+    int variant;
+    int base;
+} mode_twin_t;
+
+static mode_twin_t mode_twin[NU_BUILTIN_MEMCPY_VARIANTS + NU_BUILTIN_MEMSET_VARIANTS];
+static int nu_mode_twins;
+
+/* Return the built-in variant an other-mode encoding was derived from. */
+static const void *mode_twin_base(const void *func) {
+    for (int i = 0; i < nu_mode_twins; i++) {
+        const mode_twin_t *t = &mode_twin[i];
+        if (t->is_memset && (const void *)memset_variant[t->variant] == func)
+            return (const void *)memset_variant[t->base];
+        if (!t->is_memset && (const void *)memcpy_variant[t->variant] == func)
+            return (const void *)memcpy_variant[t->base];
+    }
+    return func;
+}
+
+static int is_mode_twin(int is_memset, int variant) {
+    for (int i = 0; i < nu_mode_twins; i++)
+        if (mode_twin[i].is_memset == is_memset && mode_twin[i].variant == variant)
+            return 1;
+    return 0;
+}
+
+/*
+ * Variants with an alignment contract: the source and destination must be
+ * aligned to the given number of bytes and the size must be a multiple of 16.
+ * They are only run by tests that guarantee this.
+ */
+
+typedef struct {
+    const void *func;
+    int alignment;
+} alignment_contract_t;
+
+static const alignment_contract_t alignment_contract[] = {
+    { (const void *)fastarm_memcpy_aligned16, 16 },
+    { (const void *)fastarm_memcpy_aligned32, 32 },
+    { (const void *)fastarm_memcpy_aligned64, 64 },
+    { (const void *)fastarm_memset_aligned16, 16 },
+    { (const void *)fastarm_memset_aligned32, 32 },
+    { (const void *)fastarm_memset_aligned64, 64 },
+};
+
+/*
+ * Variants that use PLDW, which is only available on cores with the
+ * multiprocessing extensions.
+ */
+
+static const void *pldw_variant[] = {
+    (const void *)memcpy_new_line_size_64_preload_192_pldw_128,
+    (const void *)memcpy_new_line_size_32_preload_192_pldw_128,
+    (const void *)memcpy_new_neon_line_size_64_pldw_128,
+    (const void *)memcpy_new_neon_line_size_32_pldw_128,
+    (const void *)memset_new_align_32_pldw_128,
+    (const void *)memset_neon_pldw_128,
+};
+
+static int uses_pldw(const void *func) {
+    func = mode_twin_base(func);
+    for (int i = 0; i < sizeof(pldw_variant) / sizeof(pldw_variant[0]); i++)
+        if (pldw_variant[i] == func)
+            return 1;
+    return 0;
+}
+
+/*
+ * Return the code size of a variant from the size of its symbol, or 0 when
+ * unknown. The benchmark is linked with -rdynamic so that the symbols of the
+ * built-in variants are visible.
+ */
+static int get_code_size(const void *func) {
+    Dl_info info;
+    const ElfW(Sym) *sym = NULL;
+    if (dladdr1(func, &info, (void **)&sym, RTLD_DL_SYMENT) == 0 || sym == NULL)
+        return 0;
+    return sym->st_size;
+}
+
+/* Return the alignment required by a variant, or 0 when there is no contract. */
+static int get_required_alignment(const void *func) {
+    func = mode_twin_base(func);
+    for (int i = 0; i < sizeof(alignment_contract) / sizeof(alignment_contract[0]); i++)
+        if (alignment_contract[i].func == func)
+            return alignment_contract[i].alignment;
+    return 0;
+}
+
 static double get_time() {
    struct timespec ts;
    clock_gettime(CLOCK_REALTIME, &ts);
@@ -572,6 +729,16 @@ static void test_memset_page_aligned_4096(int i) {
         random_buffer_1024[(i * 2 + 1) & (RANDOM_BUFFER_SIZE - 1)] & 0xFF, 4096);
 }
 
+static void test_memset_page_aligned_1M(int i) {
+    memset_func(buffer_page + random_buffer_1024[(i * 2) & (RANDOM_BUFFER_SIZE - 1)] * 4096,
+        random_buffer_1024[(i * 2 + 1) & (RANDOM_BUFFER_SIZE - 1)] & 0xFF, 1024 * 1024);
+}
+
+static void test_memset_page_aligned_8M(int i) {
+    memset_func(buffer_page + random_buffer_1024[(i * 2) & (RANDOM_BUFFER_SIZE - 1)] * 4096,
+        random_buffer_1024[(i * 2 + 1) & (RANDOM_BUFFER_SIZE - 1)] & 0xFF, 8 * 1024 * 1024);
+}
+
 static void test_memset_mixed_powers_of_two_word_aligned(int i) {
     memset_func(buffer_page + random_buffer_1M[(i * 2) & (RANDOM_BUFFER_SIZE - 1)] * 4,
         random_buffer_1M[(i * 2 + 1) & (RANDOM_BUFFER_SIZE - 1)] & 0xFF,
@@ -698,17 +865,157 @@ static void test_memset_unaligned_random_1023(int i) {
         1023);
 }
 
+static int read_sysfs_value(const char *path, char *buffer, int size) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+    int ok = fgets(buffer, size, f) != NULL;
+    fclose(f);
+    if (ok)
+        buffer[strcspn(buffer, "\n")] = '\0';
+    return ok;
+}
+
+static int read_sysfs_int(const char *path, int *value) {
+    char buffer[64];
+    if (!read_sysfs_value(path, buffer, sizeof(buffer)))
+        return 0;
+    *value = atoi(buffer);
+    return 1;
+}
+
+/*
+ * Read the current CPU frequency in MHz (0 when unknown) and SoC temperature
+ * in degrees C (NAN when unknown).
+ */
+static void read_conditions(int *freq, double *temp) {
+    char path[128];
+    int value;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+        benchmark_cpu >= 0 ? benchmark_cpu : 0);
+    *freq = read_sysfs_int(path, &value) ? value / 1000 : 0;
+    *temp = read_sysfs_int("/sys/class/thermal/thermal_zone0/temp", &value) ?
+        value / 1000.0 : NAN;
+}
+
+/* Print the current CPU frequency and SoC temperature, when available. */
+static void print_conditions() {
+    int freq;
+    double temp;
+    read_conditions(&freq, &temp);
+    if (freq > 0)
+        printf(" (%d MHz", freq);
+    else
+        printf(" (unknown frequency");
+    if (!isnan(temp))
+        printf(", %.1lf C)", temp);
+    else
+        printf(")");
+}
+
 static void clear_data_cache() {
     int val = 0;
-    for (int i = 0; i < 1024 * 1024 * 32; i += 4) {
+    for (int i = 0; i < cache_flush_size; i += 4) {
         val += buffer_alloc[i];
     }
-    for (int i = 0; i < 1024 * 1024 * 32; i += 4) {
+    for (int i = 0; i < cache_flush_size; i += 4) {
         buffer_alloc[i] = val;
     }
 }
 
-static void do_test(const char *name, void (*test_func)(int), int bytes) {
+/*
+ * Instruction cache thrashing code for --cold-icache. Each function occupies
+ * its own ICACHE_THRASH_BLOCK_SIZE byte block, so that calling all of them
+ * runs through 128 KB of code, which is larger than the L1 instruction cache
+ * of common ARM cores, evicting the code of the measured variant as happens
+ * in large programs.
+ */
+
+#define ICACHE_THRASH_BLOCK_SIZE 64
+#define ICACHE_THRASH_NU_FUNCTIONS 2048
+/* Maximum number of calls per timing round in --cold-icache mode. */
+#define COLD_ICACHE_MAX_ITERATIONS 1024
+
+static volatile int icache_thrash_sink;
+
+#define ICACHE_THRASH_FUNCTION(n) \
+    static void __attribute__((noinline, aligned(ICACHE_THRASH_BLOCK_SIZE))) \
+    icache_thrash_##n() { icache_thrash_sink += n; }
+#define ICACHE_THRASH_POINTER(n) icache_thrash_##n,
+/* Instantiate m for 2048 distinct numbers starting with the digits n. */
+#define ICACHE_THRASH_4(m, n) m(n##0) m(n##1) m(n##2) m(n##3)
+#define ICACHE_THRASH_16(m, n) ICACHE_THRASH_4(m, n##0) ICACHE_THRASH_4(m, n##1) \
+    ICACHE_THRASH_4(m, n##2) ICACHE_THRASH_4(m, n##3)
+#define ICACHE_THRASH_64(m, n) ICACHE_THRASH_16(m, n##0) ICACHE_THRASH_16(m, n##1) \
+    ICACHE_THRASH_16(m, n##2) ICACHE_THRASH_16(m, n##3)
+#define ICACHE_THRASH_256(m, n) ICACHE_THRASH_64(m, n##0) ICACHE_THRASH_64(m, n##1) \
+    ICACHE_THRASH_64(m, n##2) ICACHE_THRASH_64(m, n##3)
+#define ICACHE_THRASH_1024(m, n) ICACHE_THRASH_256(m, n##0) ICACHE_THRASH_256(m, n##1) \
+    ICACHE_THRASH_256(m, n##2) ICACHE_THRASH_256(m, n##3)
+#define ICACHE_THRASH_2048(m) ICACHE_THRASH_1024(m, 1) ICACHE_THRASH_1024(m, 2)
+
+ICACHE_THRASH_2048(ICACHE_THRASH_FUNCTION)
+
+static void (* const icache_thrash_function[ICACHE_THRASH_NU_FUNCTIONS])() = {
+    ICACHE_THRASH_2048(ICACHE_THRASH_POINTER)
+};
+
+static void thrash_icache() {
+    for (int i = 0; i < ICACHE_THRASH_NU_FUNCTIONS; i++)
+        icache_thrash_function[i]();
+}
+
+static int64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void test_empty(int i) {
+}
+
+/*
+ * Return the total time in seconds of the calls of test_func, each preceded
+ * by thrashing the instruction cache. Only the calls themselves are timed.
+ */
+static double time_calls_cold_icache(void (*test_func)(int), int nu_iterations) {
+    int64_t total = 0;
+    for (int i = 0; i < nu_iterations; i++) {
+        thrash_icache();
+        int64_t start_time = get_time_ns();
+        test_func(i);
+        total += get_time_ns() - start_time;
+    }
+    return total / 1000000000.0;
+}
+
+/*
+ * Version of time_test for --cold-icache. The overhead of reading the timer
+ * and of calling the (empty) test function with a cold instruction cache is
+ * measured alongside and subtracted.
+ */
+static double time_test_cold_icache(void (*test_func)(int)) {
+    int nu_iterations = COLD_ICACHE_MAX_ITERATIONS;
+    clear_data_cache();
+    time_calls_cold_icache(test_func, nu_iterations);
+    usleep(100000);
+    double start_time = get_time();
+    double total = 0, overhead = 0;
+    int count = 0;
+    do {
+        total += time_calls_cold_icache(test_func, nu_iterations);
+        overhead += time_calls_cold_icache(test_empty, nu_iterations);
+        count++;
+    } while (get_time() - start_time < test_duration);
+    double t = (total - overhead) / ((double)nu_iterations * count);
+    /* Guard against a result below the timer resolution. */
+    return t > 1.0e-9 ? t : 1.0e-9;
+}
+
+/* Return the average time in seconds of a call of test_func. */
+static double time_test(void (*test_func)(int), int bytes) {
+    if (cold_icache)
+        return time_test_cold_icache(test_func);
     int nu_iterations;
     if (bytes >= 1024) 
         nu_iterations = (64 * 1024 * 1024) / bytes;
@@ -733,13 +1040,294 @@ static void do_test(const char *name, void (*test_func)(int), int bytes) {
         if (end_time - start_time >= test_duration)
             break;
     }
-    double bandwidth = (double)bytes * nu_iterations * count / (1024 * 1024)
-        / (end_time - start_time);
-    printf("%s: %.2lf MB/s\n", name, bandwidth);
+    return (end_time - start_time) / ((double)nu_iterations * count);
+}
+
+/*
+ * Roofline reporting (--roofline). The peak read, write and copy bandwidth of
+ * the L1 and L2 caches and of DRAM are measured first with simple NEON and
+ * LDM/STM streaming kernels (see measure_roofline_peaks). Every test result
+ * is then also reported as a percentage of the matching peak: the write peak
+ * for memset, the copy peak for memcpy, at the level that holds the data
+ * touched by a single call (source and destination for memcpy). Tests with
+ * DRAM in their name are matched with DRAM.
+ */
+
+#define ROOFLINE_L1 0
+#define ROOFLINE_L2 1
+#define ROOFLINE_DRAM 2
+#define ROOFLINE_NU_LEVELS 3
+#define ROOFLINE_READ 0
+#define ROOFLINE_WRITE 1
+#define ROOFLINE_COPY 2
+#define ROOFLINE_NU_KINDS 3
+
+int roofline;
+/* Whether the test being run by run_test is a memset test. */
+static int roofline_is_memset;
+/* Cache sizes in bytes; defaults when not reported by the kernel. */
+static int roofline_cache_size[2] = { 32 * 1024, 512 * 1024 };
+static double roofline_peak[ROOFLINE_NU_LEVELS][ROOFLINE_NU_KINDS];
+static const char *roofline_level_name[ROOFLINE_NU_LEVELS] = { "L1", "L2", "DRAM" };
+static const char *roofline_kind_name[ROOFLINE_NU_KINDS] = { "read", "write", "copy" };
+
+static void print_roofline(const char *name, int bytes, double bandwidth) {
+    int footprint = roofline_is_memset ? bytes : bytes * 2;
+    int level = ROOFLINE_DRAM;
+    if (strstr(name, "DRAM") == NULL) {
+        if (footprint <= roofline_cache_size[0])
+            level = ROOFLINE_L1;
+        else if (footprint <= roofline_cache_size[1])
+            level = ROOFLINE_L2;
+    }
+    int kind = roofline_is_memset ? ROOFLINE_WRITE : ROOFLINE_COPY;
+    printf(" (%.1lf%% of %s %s peak)", bandwidth * 100.0 / roofline_peak[level][kind],
+        roofline_level_name[level], roofline_kind_name[kind]);
+}
+
+/*
+ * Calibrated measurement (--calibrated). The (dest, src, n) triples of the
+ * calls made by a test are recorded first by running the test with a
+ * recording function in place of the variant. They are then replayed from a
+ * cache-resident array in a tight loop that calls the variant directly. The
+ * same loop is timed with an empty function to measure the overhead of the
+ * loop and the call, which is subtracted. Cycles are counted with the
+ * hardware cycle counter when perf events are available, and otherwise
+ * derived from the current CPU frequency. For tests with DRAM in their name,
+ * the data cache is flushed before each pass over the recorded calls and only
+ * the passes themselves are timed, so that their data is not replayed from
+ * the cache.
+ */
+
+#define CALIBRATED_NU_CALLS 1024
+
+typedef struct {
+    void *dest;
+    const void *src;
+    size_t n;
+    int c;
+} recorded_call_t;
+
+int calibrated;
+static recorded_call_t recorded_call[CALIBRATED_NU_CALLS];
+static int nu_recorded_calls;
+static int recorded_memset;
+
+static void *record_memcpy(void *dest, const void *src, size_t n) {
+    if (nu_recorded_calls < CALIBRATED_NU_CALLS) {
+        recorded_call_t *r = &recorded_call[nu_recorded_calls++];
+        r->dest = dest;
+        r->src = src;
+        r->n = n;
+    }
+    return dest;
+}
+
+static void *record_memset(void *dest, int c, size_t n) {
+    if (nu_recorded_calls < CALIBRATED_NU_CALLS) {
+        recorded_call_t *r = &recorded_call[nu_recorded_calls++];
+        r->dest = dest;
+        r->c = c;
+        r->n = n;
+    }
+    recorded_memset = 1;
+    return dest;
+}
+
+static void * __attribute__((noinline)) empty_memcpy(void *dest, const void *src, size_t n) {
+    __asm__ volatile ("" : : : "memory");
+    return dest;
+}
+
+static void * __attribute__((noinline)) empty_memset(void *dest, int c, size_t n) {
+    __asm__ volatile ("" : : : "memory");
+    return dest;
+}
+
+static void __attribute__((noinline)) replay_memcpy(memcpy_func_type func, int rounds) {
+    for (int k = 0; k < rounds; k++)
+        for (const recorded_call_t *r = recorded_call; r < recorded_call + nu_recorded_calls; r++)
+            func(r->dest, r->src, r->n);
+}
+
+static void __attribute__((noinline)) replay_memset(memset_func_type func, int rounds) {
+    for (int k = 0; k < rounds; k++)
+        for (const recorded_call_t *r = recorded_call; r < recorded_call + nu_recorded_calls; r++)
+            func(r->dest, r->c, r->n);
+}
+
+static int open_cycle_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, - 1, - 1, 0);
+}
+
+static uint64_t read_cycle_counter(int fd) {
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
+
+/* Replay in single passes, flushing the data cache outside the timed region. */
+static double time_replay_flushed(void *func, int fd, double *cycles) {
+    double start_time = get_time();
+    double t = 0, c = 0;
+    int count = 0;
+    do {
+        clear_data_cache();
+        double pass_start_time = get_time();
+        uint64_t pass_start_cycles = fd >= 0 ? read_cycle_counter(fd) : 0;
+        if (recorded_memset)
+            replay_memset((memset_func_type)func, 1);
+        else
+            replay_memcpy((memcpy_func_type)func, 1);
+        if (fd >= 0)
+            c += read_cycle_counter(fd) - pass_start_cycles;
+        t += get_time() - pass_start_time;
+        count++;
+    }
+    while (get_time() - start_time < test_duration / 2);
+    double nu_calls = (double)count * nu_recorded_calls;
+    *cycles = fd >= 0 ? c / nu_calls : 0;
+    return t / nu_calls;
+}
+
+/*
+ * Replay the recorded calls with func (a memcpy or memset function) for the
+ * test duration. Returns the time per call and sets the cycles per call (0
+ * when no cycle counter is available). When flush is set, the data cache is
+ * flushed before each pass over the recorded calls.
+ */
+static double time_replay(void *func, int fd, double *cycles, int flush) {
+    if (flush)
+        return time_replay_flushed(func, fd, cycles);
+    int rounds = 1;
+    /* Aim for rounds of about 64 MB or 1/20th of the test duration. */
+    size_t bytes = 0;
+    for (int i = 0; i < nu_recorded_calls; i++)
+        bytes += recorded_call[i].n;
+    if (bytes < 64 * 1024 * 1024)
+        rounds = 64 * 1024 * 1024 / (bytes + 1) + 1;
+    if (rounds > 256)
+        rounds = 256;
+    double start_time = get_time();
+    uint64_t start_cycles = fd >= 0 ? read_cycle_counter(fd) : 0;
+    double end_time;
+    int count = 0;
+    for (;;) {
+        if (recorded_memset)
+            replay_memset((memset_func_type)func, rounds);
+        else
+            replay_memcpy((memcpy_func_type)func, rounds);
+        count += rounds;
+        end_time = get_time();
+        if (end_time - start_time >= test_duration / 2)
+            break;
+    }
+    double nu_calls = (double)count * nu_recorded_calls;
+    *cycles = fd >= 0 ? (read_cycle_counter(fd) - start_cycles) / nu_calls : 0;
+    return (end_time - start_time) / nu_calls;
+}
+
+static double do_test_calibrated(const char *name, void (*test_func)(int), int bytes) {
+    memcpy_func_type saved_memcpy_func = memcpy_func;
+    memset_func_type saved_memset_func = memset_func;
+    memcpy_func = record_memcpy;
+    memset_func = record_memset;
+    nu_recorded_calls = 0;
+    recorded_memset = 0;
+    for (int i = 0; nu_recorded_calls < CALIBRATED_NU_CALLS && i < 16 * CALIBRATED_NU_CALLS; i++)
+        test_func(i);
+    memcpy_func = saved_memcpy_func;
+    memset_func = saved_memset_func;
+    if (nu_recorded_calls == 0) {
+        printf("%s: skipped (no memcpy or memset calls to record)\n", name);
+        return 0;
+    }
+    double average_bytes = 0;
+    for (int i = 0; i < nu_recorded_calls; i++)
+        average_bytes += recorded_call[i].n;
+    average_bytes /= nu_recorded_calls;
+
+    int fd = open_cycle_counter();
+    void *func = recorded_memset ? (void *)memset_func : (void *)memcpy_func;
+    void *empty = recorded_memset ? (void *)empty_memset : (void *)empty_memcpy;
+    double cycles, empty_cycles;
+    /* Warm-up. */
+    clear_data_cache();
+    if (recorded_memset)
+        replay_memset((memset_func_type)func, 1);
+    else
+        replay_memcpy((memcpy_func_type)func, 1);
+    int flush = strstr(name, "DRAM") != NULL;
+    double t = time_replay(func, fd, &cycles, flush);
+    double overhead = time_replay(empty, fd, &empty_cycles, flush);
+    if (fd >= 0)
+        close(fd);
+    else {
+        int freq;
+        char path[128];
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", sched_getcpu());
+        if (read_sysfs_int(path, &freq)) {
+            cycles = t * freq * 1000.0;
+            empty_cycles = overhead * freq * 1000.0;
+        }
+    }
+    double net = t - overhead;
+    /* Guard against a result below the timer resolution. */
+    if (net < 1.0e-10)
+        net = 1.0e-10;
+    double bandwidth = average_bytes / (1024 * 1024) / net;
+    printf("%s: %.2lf MB/s", name, bandwidth);
+    if (cycles > 0) {
+        double net_cycles = cycles - empty_cycles;
+        printf(", %.3lf bytes/cycle (%.1lf cycles per call", net_cycles > 0 ?
+            average_bytes / net_cycles : 0.0, net_cycles);
+        printf(", harness overhead %.1lf cycles = %.0lf%% of the raw time)", empty_cycles,
+            overhead * 100.0 / t);
+    }
+    else
+        printf(" (harness overhead %.1lf ns per call = %.0lf%% of the raw time)",
+            overhead * 1.0e9, overhead * 100.0 / t);
+    if (roofline)
+        print_roofline(name, average_bytes, bandwidth);
+    if (interleave)
+        print_conditions();
+    printf("\n");
+    return bandwidth;
+}
+
+static double do_test(const char *name, void (*test_func)(int), int bytes) {
+    if (calibrated)
+        return do_test_calibrated(name, test_func, bytes);
+    double bandwidth = (double)bytes / (1024 * 1024) / time_test(test_func, bytes);
+    printf("%s: %.2lf MB/s", name, bandwidth);
+    if (roofline)
+        print_roofline(name, bytes, bandwidth);
+    if (interleave)
+        print_conditions();
+    printf("\n");
+    return bandwidth;
+}
+
+static double do_scenario(const char *name, void (*scenario_func)(int), int bytes) {
+    double t = time_test(scenario_func, bytes);
+    double bandwidth = (double)bytes / (1024 * 1024) / t;
+    printf("%s: %.3lf us per operation (%.2lf MB/s)", name, t * 1000000.0, bandwidth);
+    if (interleave)
+        print_conditions();
+    printf("\n");
+    return bandwidth;
 }
 
 static void do_test_all(const char *name, void (*test_func)(), int bytes) {
-    for (int j = 0; j < NU_MEMCPY_VARIANTS; j++)
+    for (int j = 0; j < nu_memcpy_variants; j++)
         if (memcpy_mask[j]) {
             printf("%s:\n", memcpy_variant_name[j]);
             memcpy_func = memcpy_variant[j];
@@ -747,211 +1335,3107 @@ static void do_test_all(const char *name, void (*test_func)(), int bytes) {
         }
 }
 
-static void fill_buffer(uint8_t *buffer) {
-    uint32_t v = 0xEEAAEEAA;
-    for (int i = 0; i < 1024 * 1024 * 16; i++) {
-        buffer[i] = (v >> 24);
-        v += i ^ 0x12345678;
+/*
+ * Recording of results and comparison against a saved baseline. The results
+ * of each (variant, test) pair are kept as a distribution of repeated
+ * measurements, so that a slowdown can be judged statistically. The CPU
+ * frequency and temperature at the time of each measurement are kept with it,
+ * so that a throttled run can be told apart from a regression.
+ */
+
+#define MAX_SAMPLES 1000
+#define EXACT_MANN_WHITNEY_LIMIT 20
+
+typedef struct {
+    char *variant;
+    char *test;
+    int nu_samples;
+    double *sample;
+    int *freq;
+    double *temp;
+} result_t;
+
+typedef struct {
+    int nu_results;
+    int max_results;
+    result_t *result;
+} result_set_t;
+
+static result_set_t current_results;
+
+static result_t *find_result(result_set_t *set, const char *variant, const char *test,
+int create) {
+    for (int i = 0; i < set->nu_results; i++)
+        if (strcmp(set->result[i].variant, variant) == 0 &&
+        strcmp(set->result[i].test, test) == 0)
+            return &set->result[i];
+    if (!create)
+        return NULL;
+    if (set->nu_results == set->max_results) {
+        set->max_results = set->max_results == 0 ? 64 : set->max_results * 2;
+        set->result = realloc(set->result, sizeof(result_t) * set->max_results);
     }
+    result_t *r = &set->result[set->nu_results++];
+    r->variant = strdup(variant);
+    r->test = strdup(test);
+    r->nu_samples = 0;
+    r->sample = malloc(sizeof(double) * MAX_SAMPLES);
+    r->freq = malloc(sizeof(int) * MAX_SAMPLES);
+    r->temp = malloc(sizeof(double) * MAX_SAMPLES);
+    return r;
 }
 
-static int compare_buffers(uint8_t *buffer0, uint8_t *buffer1) {
-    int identical = 1;
-    int count = 0;
-    for (int i = 0; i < 1024 * 1024 * 16; i++) {
-        if (buffer0[i] != buffer1[i]) {
-            count++;
-	    if (count < 10) {
-                printf("Byte at offset %d (0x%08X) doesn't match.\n",
-                    i, i);
-                identical = 0;
-            }
-	}
+static void add_sample(result_set_t *set, const char *variant, const char *test, double value,
+int freq, double temp) {
+    result_t *r = find_result(set, variant, test, 1);
+    if (r->nu_samples < MAX_SAMPLES) {
+        r->sample[r->nu_samples] = value;
+        r->freq[r->nu_samples] = freq;
+        r->temp[r->nu_samples] = temp;
+        r->nu_samples++;
     }
-    if (count >= 10) {
-        printf("(%d more non-matching bytes present.)\n", count - 9);
-    }
-    return identical;
 }
 
-static void memcpy_emulate(uint8_t *dest, uint8_t *src, int size) {
-    for (int i = 0; i < size; i++)
-        dest[i] = src[i];
+static void record_result(const char *variant, const char *test, double bandwidth) {
+    int freq;
+    double temp;
+    read_conditions(&freq, &temp);
+    add_sample(&current_results, variant, test, bandwidth, freq, temp);
 }
 
-static void do_validation(int repeat) {
-    int passed = 1;
-    for (int i = 0; i < 10 * repeat; i++)  {
-        int size, source, dest;
-            size = floor(pow(2.0, (double)rand() * 20.0 / RAND_MAX));
-            source = rand() % (1024 * 1024 * 16 + 1 - size);
-            int aligned = 0;
-            if ((rand() & 3) == 0) {
-		aligned = 1;
-                source &= ~3;
-                size = (size + 3) & (~3);
-            }
-            do {
-                dest = rand() % (1024 * 1024 * 16 + 1 - size);
-                if (aligned)
-                    dest &= ~3;
-            }
-            while (dest + size > source && dest < source + size);
-        printf("Testing (source offset = 0x%08X, destination offset = 0x%08X, size = %d).\n",
-                source, dest, size);
-        fflush(stdout);
-        fill_buffer(buffer_compare);
-        memcpy_emulate(buffer_compare + dest, buffer_compare + source, size);
-        fill_buffer(buffer_page);
-        if (memcpy_func(buffer_page + dest, buffer_page + source, size) != buffer_page + dest) {
-            printf("Validation failed: function did not return original destination address.\n");
-            passed = 0;
-        }
-        if (!compare_buffers(buffer_page, buffer_compare)) {
-            printf("Validation failed (source offset = 0x%08X, destination offset = 0x%08X, size = %d).\n",
-                source, dest, size);
-            passed = 0;
-        }
+/*
+ * The baseline file has one line per (variant, test) pair, with the fields
+ * separated by tabs: variant name, test name, number of samples, followed by
+ * the samples. Each sample is written as MB/s,MHz,C (the frequency is 0 and
+ * the temperature nan when unknown); samples with only the MB/s value, as
+ * written by earlier versions, are read with unknown conditions.
+ */
+static int save_results(result_set_t *set, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        printf("Unable to create baseline file %s.\n", filename);
+        return 0;
     }
-    if (passed) {
-        printf("Passed.\n");
+    for (int i = 0; i < set->nu_results; i++) {
+        result_t *r = &set->result[i];
+        fprintf(f, "%s\t%s\t%d", r->variant, r->test, r->nu_samples);
+        for (int j = 0; j < r->nu_samples; j++)
+            fprintf(f, "\t%.2lf,%d,%.1lf", r->sample[j], r->freq[j], r->temp[j]);
+        fprintf(f, "\n");
     }
+    fclose(f);
+    return 1;
 }
 
-static void memset_emulate(uint8_t *dest, int c, int size) {
-    for (int i = 0; i < size; i++)
-        dest[i] = c;
-}
-
-static void do_validation_memset(int repeat) {
-    int passed = 1;
-    for (int i = 0; i < 10 * repeat; i++)  {
-        int size, dest, c;
-        size = floor(pow(2.0, (double)rand() * 20.0 / RAND_MAX));
-        dest = rand() % (1024 * 1024 * 16 + 1 - size);
-        c = rand() & 0xFF;
-        printf("Testing (destination offset = 0x%08X, byte = %d, size = %d).\n",
-                dest, c, size);
-        fflush(stdout);
-        fill_buffer(buffer_compare);
-        memset_emulate(buffer_compare + dest, c, size);
-        fill_buffer(buffer_page);
-        if (memset_func(buffer_page + dest, c, size) != buffer_page + dest) {
-                printf("Validation failed: function did not return original destination address.\n");
-                passed = 0;
+static int load_results(result_set_t *set, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        printf("Unable to open baseline file %s.\n", filename);
+        return 0;
+    }
+    char line[65536];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        char *variant = strtok(line, "\t");
+        char *test = strtok(NULL, "\t");
+        char *count = strtok(NULL, "\t");
+        if (variant == NULL || test == NULL || count == NULL) {
+            printf("Syntax error in baseline file %s on line %d.\n", filename, line_number);
+            fclose(f);
+            return 0;
         }
-        if (!compare_buffers(buffer_page, buffer_compare)) {
-            printf("Validation failed (destination offset = 0x%08X, size = %d).\n",
-                dest, size);
-            passed = 0;
+        int n = atoi(count);
+        for (int i = 0; i < n; i++) {
+            char *s = strtok(NULL, "\t");
+            if (s == NULL)
+                break;
+            double value, temp = NAN;
+            int freq = 0;
+            if (sscanf(s, "%lf,%d,%lf", &value, &freq, &temp) < 1) {
+                printf("Syntax error in baseline file %s on line %d.\n", filename,
+                    line_number);
+                fclose(f);
+                return 0;
+            }
+            add_sample(set, variant, test, value, freq, temp);
         }
     }
-    if (passed) {
-        printf("Passed.\n");
-    }
+    fclose(f);
+    return 1;
 }
 
-#define NU_TESTS 48
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? - 1 : (x > y ? 1 : 0);
+}
+
+static double median(const double *sample, int n) {
+    double *sorted = malloc(sizeof(double) * n);
+    memcpy(sorted, sample, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), compare_double);
+    double m = (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) * 0.5;
+    free(sorted);
+    return m;
+}
+
+/*
+ * Number of arrangements of n1 + n2 distinct values in which the
+ * Mann-Whitney U statistic of the first group is at most u.
+ */
+static double mann_whitney_count(int n1, int n2, int u, double *memo, int stride) {
+    if (u < 0)
+        return 0;
+    if (n1 == 0 || n2 == 0)
+        return 1;
+    double *m = &memo[(n1 * (EXACT_MANN_WHITNEY_LIMIT + 1) + n2) * stride + u];
+    if (*m < 0)
+        *m = mann_whitney_count(n1 - 1, n2, u - n2, memo, stride) +
+            mann_whitney_count(n1, n2 - 1, u, memo, stride);
+    return *m;
+}
+
+static double binomial(int n, int k) {
+    double c = 1;
+    for (int i = 1; i <= k; i++)
+        c = c * (n - k + i) / i;
+    return c;
+}
+
+/*
+ * One-sided Mann-Whitney U test of the hypothesis that the values in a
+ * (the current results) tend to be smaller than those in b (the baseline).
+ * Returns the p-value. The exact distribution is used for small samples
+ * without ties, the normal approximation with tie correction otherwise.
+ */
+static double mann_whitney_p(const double *a, int n1, const double *b, int n2) {
+    double u = 0;
+    int ties = 0;
+    for (int i = 0; i < n1; i++)
+        for (int j = 0; j < n2; j++) {
+            if (a[i] > b[j])
+                u += 1;
+            else if (a[i] == b[j]) {
+                u += 0.5;
+                ties = 1;
+            }
+        }
+    if (!ties && n1 <= EXACT_MANN_WHITNEY_LIMIT && n2 <= EXACT_MANN_WHITNEY_LIMIT) {
+        int stride = n1 * n2 + 1;
+        int size = (EXACT_MANN_WHITNEY_LIMIT + 1) * (EXACT_MANN_WHITNEY_LIMIT + 1) * stride;
+        double *memo = malloc(sizeof(double) * size);
+        for (int i = 0; i < size; i++)
+            memo[i] = - 1;
+        double p = mann_whitney_count(n1, n2, (int)u, memo, stride) / binomial(n1 + n2, n1);
+        free(memo);
+        return p;
+    }
+    /* Tie correction of the variance, using the ranks of the pooled samples. */
+    int n = n1 + n2;
+    double *pooled = malloc(sizeof(double) * n);
+    memcpy(pooled, a, sizeof(double) * n1);
+    memcpy(pooled + n1, b, sizeof(double) * n2);
+    qsort(pooled, n, sizeof(double), compare_double);
+    double tie_sum = 0;
+    for (int i = 0; i < n;) {
+        int j = i;
+        while (j < n && pooled[j] == pooled[i])
+            j++;
+        double t = j - i;
+        tie_sum += t * t * t - t;
+        i = j;
+    }
+    free(pooled);
+    double mean = n1 * n2 * 0.5;
+    double variance = n1 * n2 / 12.0 * ((n + 1) - tie_sum / ((double)n * (n - 1)));
+    if (variance <= 0)
+        return 1.0;
+    /* Continuity correction. */
+    double z = (u + 0.5 - mean) / sqrt(variance);
+    return 0.5 * erfc(- z / sqrt(2.0));
+}
+
+/*
+ * Median CPU frequency and temperature of the samples for which they are
+ * known, or 0 and NAN.
+ */
+static void median_conditions(const result_t *r, double *freq, double *temp) {
+    double *known = malloc(sizeof(double) * r->nu_samples);
+    int n = 0;
+    for (int i = 0; i < r->nu_samples; i++)
+        if (r->freq[i] > 0)
+            known[n++] = r->freq[i];
+    *freq = n > 0 ? median(known, n) : 0;
+    n = 0;
+    for (int i = 0; i < r->nu_samples; i++)
+        if (!isnan(r->temp[i]))
+            known[n++] = r->temp[i];
+    *temp = n > 0 ? median(known, n) : NAN;
+    free(known);
+}
+
+/*
+ * Compare the current results with a baseline. A (variant, test) pair is
+ * reported as a regression when the median bandwidth dropped by more than
+ * threshold percent and the drop is significant at the given level. The
+ * median CPU frequency and temperature of both runs are shown when known,
+ * and a regression for which the median frequency also dropped by more than
+ * threshold percent is marked as possibly caused by throttling.
+ * Returns the number of regressions.
+ */
+static int compare_results(result_set_t *baseline, result_set_t *current, double threshold,
+double significance) {
+    int regressions = 0;
+    int throttled = 0;
+    int compared = 0;
+    int too_few_samples = 0;
+    printf("\nComparison with baseline (regression: median drop > %.1lf%% with confidence "
+        ">= %.1lf%%):\n", threshold, (1.0 - significance) * 100.0);
+    for (int i = 0; i < current->nu_results; i++) {
+        result_t *c = &current->result[i];
+        result_t *b = find_result(baseline, c->variant, c->test, 0);
+        if (b == NULL || b->nu_samples == 0 || c->nu_samples == 0)
+            continue;
+        compared++;
+        double median_b = median(b->sample, b->nu_samples);
+        double median_c = median(c->sample, c->nu_samples);
+        double change = (median_c - median_b) * 100.0 / median_b;
+        double p = mann_whitney_p(c->sample, c->nu_samples, b->sample, b->nu_samples);
+        if (1.0 / binomial(b->nu_samples + c->nu_samples, c->nu_samples) > significance)
+            too_few_samples = 1;
+        double freq_b, temp_b, freq_c, temp_c;
+        median_conditions(b, &freq_b, &temp_b);
+        median_conditions(c, &freq_c, &temp_c);
+        const char *verdict = "";
+        if (change < - threshold && p <= significance) {
+            verdict = " REGRESSION";
+            regressions++;
+            if (freq_b > 0 && freq_c > 0 && (freq_c - freq_b) * 100.0 / freq_b < - threshold) {
+                verdict = " REGRESSION (lower CPU frequency, possibly throttled)";
+                throttled++;
+            }
+        }
+        else if (change > threshold && 1.0 - p <= significance)
+            verdict = " improvement";
+        printf("%s: %s: %.2lf -> %.2lf MB/s (%+.1lf%%, confidence of slowdown %.1lf%%",
+            c->variant, c->test, median_b, median_c, change, (1.0 - p) * 100.0);
+        if (freq_b > 0 && freq_c > 0)
+            printf(", %.0lf -> %.0lf MHz", freq_b, freq_c);
+        if (!isnan(temp_b) && !isnan(temp_c))
+            printf(", %.1lf -> %.1lf C", temp_b, temp_c);
+        printf(")%s\n", verdict);
+    }
+    if (compared == 0)
+        printf("No results in common with the baseline.\n");
+    if (too_few_samples)
+        printf("Warning: too few samples to reach the required confidence; increase --repeat.\n");
+    printf("%d regression(s) in %d comparison(s).\n", regressions, compared);
+    if (throttled > 0)
+        printf("%d of the regressions ran at a lower CPU frequency than the baseline; check "
+            "for thermal throttling before trusting them.\n", throttled);
+    return regressions;
+}
+
+/*
+ * Scheduling of measurements. With interleaving enabled, each repeat runs
+ * the selected variants once in a freshly randomized order, so that slow
+ * drift such as thermal throttling is spread evenly over the variants
+ * instead of penalizing whichever variant happens to run last.
+ */
+
+/*
+ * Pin the benchmark to the given core and check the cpufreq governor.
+ * Returns 0 when the conditions are unsuitable for measurements.
+ */
+static int setup_benchmark_cpu(int force) {
+    if (benchmark_cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(benchmark_cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            printf("Unable to pin to core %d.\n", benchmark_cpu);
+            return 0;
+        }
+    }
+    char path[128], governor[64];
+    int cpu = benchmark_cpu >= 0 ? benchmark_cpu : 0;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+    if (!read_sysfs_value(path, governor, sizeof(governor)))
+        return 1;
+    int min_freq, max_freq, cur_freq;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_min_freq", cpu);
+    int have_range = read_sysfs_int(path, &min_freq);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_max_freq", cpu);
+    have_range &= read_sysfs_int(path, &max_freq);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    if (read_sysfs_int(path, &cur_freq))
+        printf("Core %d: governor %s, current frequency %d MHz.\n", cpu, governor,
+            cur_freq / 1000);
+    if (strcmp(governor, "performance") == 0 || strcmp(governor, "userspace") == 0 ||
+    (have_range && min_freq == max_freq))
+        return 1;
+    if (strcmp(governor, "ondemand") == 0 && !force) {
+        printf("The ondemand governor changes the frequency during the measurements. Select the\n"
+            "performance governor or use --force to measure anyway.\n");
+        return 0;
+    }
+    printf("Warning: governor %s may change the frequency during the measurements.\n",
+        governor);
+    return 1;
+}
+
+static void shuffle_variants(int *v, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = v[i];
+        v[i] = v[j];
+        v[j] = t;
+    }
+}
+
+static void print_ranking(const char *test_name, const int *variant, int n,
+const char * const *variant_name) {
+    double m[MAX_MEMCPY_VARIANTS];
+    int order[MAX_MEMCPY_VARIANTS];
+    for (int k = 0; k < n; k++) {
+        result_t *r = find_result(&current_results, variant_name[variant[k]], test_name, 0);
+        m[k] = r != NULL ? median(r->sample, r->nu_samples) : 0;
+        order[k] = k;
+    }
+    for (int k = 1; k < n; k++)
+        for (int l = k; l > 0 && m[order[l]] > m[order[l - 1]]; l--) {
+            int t = order[l];
+            order[l] = order[l - 1];
+            order[l - 1] = t;
+        }
+    printf("Ranking for %s (median):\n", test_name);
+    for (int k = 0; k < n; k++)
+        printf("%2d. %s: %.2lf MB/s\n", k + 1, variant_name[variant[order[k]]], m[order[k]]);
+}
+
+/*
+ * Background memory pressure. Noise threads running a streaming read,
+ * streaming write or random pointer chase pattern over their own buffer are
+ * pinned to cores other than the measured one. Each measurement is then
+ * done without and with the background load active.
+ */
+
+#define NOISE_BUFFER_SIZE (16 * 1024 * 1024)
+#define MAX_NOISE_THREADS 16
+
+enum { NOISE_READ, NOISE_WRITE, NOISE_CHASE, NOISE_MIXED };
+
+static const char *noise_pattern_name[4] = { "read", "write", "chase", "mixed" };
+
+typedef struct {
+    pthread_t thread;
+    int pattern;
+    int cpu;
+    uint8_t *buffer;
+} noise_thread_t;
+
+int nu_noise_threads;
+int noise_pattern = NOISE_READ;
+static noise_thread_t noise_thread[MAX_NOISE_THREADS];
+static int noise_active;
+static int noise_stop;
+static void * volatile noise_sink;
+
+static void *noise_main(void *arg) {
+    noise_thread_t *nt = arg;
+    if (nt->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(nt->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    uint32_t *p = (uint32_t *)nt->buffer;
+    uint32_t sum = 0;
+    void **q = (void **)nt->buffer;
+    while (!__atomic_load_n(&noise_stop, __ATOMIC_RELAXED)) {
+        if (!__atomic_load_n(&noise_active, __ATOMIC_RELAXED)) {
+            usleep(1000);
+            continue;
+        }
+        /* One pass over the buffer (or an equivalent number of chase steps). */
+        switch (nt->pattern) {
+        case NOISE_READ :
+            for (int i = 0; i < NOISE_BUFFER_SIZE / 4; i += 8)
+                sum += p[i] + p[i + 4];
+            break;
+        case NOISE_WRITE :
+            for (int i = 0; i < NOISE_BUFFER_SIZE / 4; i += 8) {
+                p[i] = i; p[i + 1] = i; p[i + 2] = i; p[i + 3] = i;
+                p[i + 4] = i; p[i + 5] = i; p[i + 6] = i; p[i + 7] = i;
+            }
+            __asm__ volatile ("" : : "r" (p) : "memory");
+            break;
+        case NOISE_CHASE :
+            for (int i = 0; i < NOISE_BUFFER_SIZE / 1024; i++)
+                q = *q;
+            break;
+        }
+    }
+    noise_sink = (void *)((uintptr_t)sum + (uintptr_t)q);
+    return NULL;
+}
+
+/* Link the 64-byte nodes of a noise buffer in random order. */
+static void create_noise_chain(uint8_t *buffer) {
+    int n = NOISE_BUFFER_SIZE / 64;
+    int *order = malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    uint32_t seed = 0x12345678;
+    for (int i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        int j = (seed >> 8) % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (int i = 0; i < n; i++)
+        *(void **)(buffer + order[i] * 64) = buffer + order[(i + 1) % n] * 64;
+    free(order);
+}
+
+/* Start the noise threads on the cores following the measured core. */
+static int start_noise_threads() {
+    int nu_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int measured_cpu = benchmark_cpu >= 0 ? benchmark_cpu : 0;
+    if (nu_cpus <= nu_noise_threads)
+        printf("Warning: not enough cores; noise threads share the measured core.\n");
+    printf("Background load: %d thread(s) with %s pattern, measured core %d.\n",
+        nu_noise_threads, noise_pattern_name[noise_pattern], measured_cpu);
+    for (int k = 0; k < nu_noise_threads; k++) {
+        noise_thread_t *nt = &noise_thread[k];
+        nt->pattern = noise_pattern == NOISE_MIXED ? k % 3 : noise_pattern;
+        nt->cpu = nu_cpus > 1 ? (measured_cpu + 1 + k % (nu_cpus - 1)) % nu_cpus : - 1;
+        if (posix_memalign((void **)&nt->buffer, 4096, NOISE_BUFFER_SIZE) != 0)
+            return 0;
+        memset(nt->buffer, 0, NOISE_BUFFER_SIZE);
+        if (nt->pattern == NOISE_CHASE)
+            create_noise_chain(nt->buffer);
+        if (pthread_create(&nt->thread, NULL, noise_main, nt) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void stop_noise_threads() {
+    __atomic_store_n(&noise_stop, 1, __ATOMIC_RELAXED);
+    for (int k = 0; k < nu_noise_threads; k++) {
+        pthread_join(noise_thread[k].thread, NULL);
+        free(noise_thread[k].buffer);
+    }
+}
+
+/*
+ * Perform a measurement; with noise threads, measure without and with the
+ * background load and return the latter.
+ */
+static double measure_with_noise(double (*measure)(const char *, void (*)(int), int),
+const char *name, void (*test_func)(int), int bytes) {
+    if (nu_noise_threads == 0)
+        return measure(name, test_func, bytes);
+    char noise_name[256];
+    snprintf(noise_name, sizeof(noise_name), "%s (quiet)", name);
+    double quiet = measure(noise_name, test_func, bytes);
+    __atomic_store_n(&noise_active, 1, __ATOMIC_RELAXED);
+    snprintf(noise_name, sizeof(noise_name), "%s (background load)", name);
+    double loaded = measure(noise_name, test_func, bytes);
+    __atomic_store_n(&noise_active, 0, __ATOMIC_RELAXED);
+    if (quiet > 0)
+        printf("Degradation under background load: %.1lf%%\n", (quiet - loaded) * 100.0 / quiet);
+    return loaded;
+}
+
+/*
+ * Run a test for all selected memcpy (is_memset == 0) or memset variants,
+ * using do_test or do_scenario as measure function.
+ */
+static void run_test(const char *test_name, void (*test_func)(int), int bytes, int alignment,
+int is_memset, int repeat, double (*measure)(const char *, void (*)(int), int)) {
+    int variant[MAX_MEMCPY_VARIANTS];
+    int n = 0;
+    int nu_variants = is_memset ? nu_memset_variants : nu_memcpy_variants;
+    const char * const *variant_name = is_memset ? memset_variant_name : memcpy_variant_name;
+    for (int j = 0; j < nu_variants; j++) {
+        if (!(is_memset ? memset_mask[j] : memcpy_mask[j]))
+            continue;
+        int required_alignment = get_required_alignment(is_memset ?
+            (const void *)memset_variant[j] : (const void *)memcpy_variant[j]);
+        if (required_alignment > alignment) {
+            printf("%s: skipped (test does not guarantee %d-byte alignment)\n", variant_name[j],
+                required_alignment);
+            continue;
+        }
+        variant[n++] = j;
+    }
+    int rounds = interleave ? repeat : n;
+    for (int round = 0; round < rounds; round++) {
+        if (interleave)
+            shuffle_variants(variant, n);
+        for (int k = 0; k < (interleave ? n : 1); k++) {
+            int j = interleave ? variant[k] : variant[round];
+            int code_size = cold_icache ? get_code_size(is_memset ?
+                (const void *)memset_variant[j] : (const void *)memcpy_variant[j]) : 0;
+            if (code_size > 0)
+                printf("%s (%d bytes of code):\n", variant_name[j], code_size);
+            else
+                printf("%s:\n", variant_name[j]);
+            if (is_memset)
+                memset_func = memset_variant[j];
+            else
+                memcpy_func = memcpy_variant[j];
+            roofline_is_memset = is_memset;
+            for (int i = 0; i < (interleave ? 1 : repeat); i++) {
+                double bandwidth = measure_with_noise(measure, test_name, test_func, bytes);
+                /* A bandwidth of 0 means the measurement was skipped. */
+                if (bandwidth > 0)
+                    record_result(variant_name[j], test_name, bandwidth);
+            }
+        }
+    }
+    if (interleave && n > 1)
+        print_ranking(test_name, variant, n, variant_name);
+}
+
+static void fill_buffer(uint8_t *buffer) {
+    uint32_t v = 0xEEAAEEAA;
+    for (int i = 0; i < 1024 * 1024 * 16; i++) {
+        buffer[i] = (v >> 24);
+        v += i ^ 0x12345678;
+    }
+}
+
+static int compare_buffers(uint8_t *buffer0, uint8_t *buffer1) {
+    int identical = 1;
+    int count = 0;
+    for (int i = 0; i < 1024 * 1024 * 16; i++) {
+        if (buffer0[i] != buffer1[i]) {
+            count++;
+	    if (count < 10) {
+                printf("Byte at offset %d (0x%08X) doesn't match.\n",
+                    i, i);
+                identical = 0;
+            }
+	}
+    }
+    if (count >= 10) {
+        printf("(%d more non-matching bytes present.)\n", count - 9);
+    }
+    return identical;
+}
+
+static void memcpy_emulate(uint8_t *dest, uint8_t *src, int size) {
+    for (int i = 0; i < size; i++)
+        dest[i] = src[i];
+}
+
+static void do_validation(int repeat) {
+    int passed = 1;
+    int required_alignment = get_required_alignment((const void *)memcpy_func);
+    for (int i = 0; i < 10 * repeat; i++)  {
+        int size, source, dest;
+            size = floor(pow(2.0, (double)rand() * 20.0 / RAND_MAX));
+            source = rand() % (1024 * 1024 * 16 + 1 - size);
+            int aligned = 0;
+            if ((rand() & 3) == 0) {
+		aligned = 1;
+                source &= ~3;
+                size = (size + 3) & (~3);
+            }
+            if (required_alignment > 0) {
+                source &= ~(required_alignment - 1);
+                size &= ~15;
+            }
+            do {
+                dest = rand() % (1024 * 1024 * 16 + 1 - size);
+                if (aligned)
+                    dest &= ~3;
+                if (required_alignment > 0)
+                    dest &= ~(required_alignment - 1);
+            }
+            while (dest + size > source && dest < source + size);
+        printf("Testing (source offset = 0x%08X, destination offset = 0x%08X, size = %d).\n",
+                source, dest, size);
+        fflush(stdout);
+        fill_buffer(buffer_compare);
+        memcpy_emulate(buffer_compare + dest, buffer_compare + source, size);
+        fill_buffer(buffer_page);
+        if (memcpy_func(buffer_page + dest, buffer_page + source, size) != buffer_page + dest) {
+            printf("Validation failed: function did not return original destination address.\n");
+            passed = 0;
+        }
+        if (!compare_buffers(buffer_page, buffer_compare)) {
+            printf("Validation failed (source offset = 0x%08X, destination offset = 0x%08X, size = %d).\n",
+                source, dest, size);
+            passed = 0;
+        }
+    }
+    if (passed) {
+        printf("Passed.\n");
+    }
+}
+
+static void memset_emulate(uint8_t *dest, int c, int size) {
+    for (int i = 0; i < size; i++)
+        dest[i] = c;
+}
+
+static void do_validation_memset(int repeat) {
+    int passed = 1;
+    int required_alignment = get_required_alignment((const void *)memset_func);
+    for (int i = 0; i < 10 * repeat; i++)  {
+        int size, dest, c;
+        size = floor(pow(2.0, (double)rand() * 20.0 / RAND_MAX));
+        dest = rand() % (1024 * 1024 * 16 + 1 - size);
+        if (required_alignment > 0) {
+            dest &= ~(required_alignment - 1);
+            size &= ~15;
+        }
+        c = rand() & 0xFF;
+        printf("Testing (destination offset = 0x%08X, byte = %d, size = %d).\n",
+                dest, c, size);
+        fflush(stdout);
+        fill_buffer(buffer_compare);
+        memset_emulate(buffer_compare + dest, c, size);
+        fill_buffer(buffer_page);
+        if (memset_func(buffer_page + dest, c, size) != buffer_page + dest) {
+                printf("Validation failed: function did not return original destination address.\n");
+                passed = 0;
+        }
+        if (!compare_buffers(buffer_page, buffer_compare)) {
+            printf("Validation failed (destination offset = 0x%08X, size = %d).\n",
+                dest, size);
+            passed = 0;
+        }
+    }
+    if (passed) {
+        printf("Passed.\n");
+    }
+}
+
+/*
+ * Validation of the entry points exported by a replacement library
+ * (--validate-exports). The run-time ABI, fortified and GNU/BSD entry points
+ * of libfastarm.so are only built in the replacement library, so they are
+ * looked up in the given library with dlsym and each one is called for every
+ * size up to EXPORT_MAX_SMALL_SIZE and a few larger sizes, with every source
+ * and destination misalignment up to 7 that the entry point allows.
+ */
+
+#define EXPORT_MAX_SMALL_SIZE 256
+#define EXPORT_GUARD_SIZE 64
+#define NU_EXPORT_LARGE_SIZES 4
+
+enum {
+    EXPORT_MEMCPY,
+    EXPORT_AEABI_MEMCPY,
+    EXPORT_MEMCPY_CHK,
+    EXPORT_MEMPCPY,
+    EXPORT_MEMSET,
+    EXPORT_AEABI_MEMSET,
+    EXPORT_MEMCLR,
+    EXPORT_MEMSET_CHK
+};
+
+typedef struct {
+    const char *symbol;
+    int kind;
+    /* Alignment of the source and destination required by the entry point. */
+    int alignment;
+} export_t;
+
+static const export_t export[] = {
+    { "memcpy", EXPORT_MEMCPY, 1 },
+    { "__aeabi_memcpy", EXPORT_AEABI_MEMCPY, 1 },
+    { "__aeabi_memcpy4", EXPORT_AEABI_MEMCPY, 4 },
+    { "__aeabi_memcpy8", EXPORT_AEABI_MEMCPY, 8 },
+    { "__memcpy_chk", EXPORT_MEMCPY_CHK, 1 },
+    { "mempcpy", EXPORT_MEMPCPY, 1 },
+    { "memset", EXPORT_MEMSET, 1 },
+    { "__aeabi_memset", EXPORT_AEABI_MEMSET, 1 },
+    { "__aeabi_memset4", EXPORT_AEABI_MEMSET, 4 },
+    { "__aeabi_memset8", EXPORT_AEABI_MEMSET, 8 },
+    { "__aeabi_memclr", EXPORT_MEMCLR, 1 },
+    { "__aeabi_memclr4", EXPORT_MEMCLR, 4 },
+    { "__aeabi_memclr8", EXPORT_MEMCLR, 8 },
+    { "bzero", EXPORT_MEMCLR, 1 },
+    { "__memset_chk", EXPORT_MEMSET_CHK, 1 },
+};
+
+static const int export_large_size[NU_EXPORT_LARGE_SIZES] = { 1000, 4099, 16384, 65557 };
+
+/*
+ * Call the entry point with the arguments of a copy or fill and return the
+ * returned pointer, or the expected value for functions that return void.
+ */
+static void *call_export(const export_t *e, void *func, uint8_t *dest, const uint8_t *src,
+int c, int size) {
+    switch (e->kind) {
+    case EXPORT_MEMCPY :
+    case EXPORT_MEMPCPY :
+        return ((void *(*)(void *, const void *, size_t))func)(dest, src, size);
+    case EXPORT_AEABI_MEMCPY :
+        ((void (*)(void *, const void *, size_t))func)(dest, src, size);
+        return dest;
+    case EXPORT_MEMCPY_CHK :
+        return ((void *(*)(void *, const void *, size_t, size_t))func)(dest, src, size, size);
+    case EXPORT_MEMSET :
+        return ((void *(*)(void *, int, size_t))func)(dest, c, size);
+    case EXPORT_AEABI_MEMSET :
+        ((void (*)(void *, size_t, int))func)(dest, size, c);
+        return dest;
+    case EXPORT_MEMCLR :
+        ((void (*)(void *, size_t))func)(dest, size);
+        return dest;
+    default :
+        return ((void *(*)(void *, int, size_t, size_t))func)(dest, c, size, size);
+    }
+}
+
+/* Returns 1 when the entry point passes for the given size and offsets. */
+static int validate_export_call(const export_t *e, void *func, int size, int src_offset,
+int dest_offset) {
+    int is_memset = e->kind >= EXPORT_MEMSET;
+    int c = e->kind == EXPORT_MEMCLR ? 0 : (0xA5 ^ size) & 0xFF;
+    int region = size + 2 * EXPORT_GUARD_SIZE;
+    uint8_t *src = buffer_page + EXPORT_GUARD_SIZE;
+    uint8_t *dest_region = buffer_page + 1024 * 1024;
+    uint8_t *dest = dest_region + EXPORT_GUARD_SIZE;
+    uint8_t *compare_region = buffer_compare;
+    for (int i = 0; i < size + 8; i++)
+        src[i] = i * 7 + size;
+    for (int i = 0; i < region + 8; i++)
+        dest_region[i] = compare_region[i] = i ^ 0x5A;
+    if (is_memset)
+        memset_emulate(compare_region + EXPORT_GUARD_SIZE + dest_offset, c, size);
+    else
+        memcpy_emulate(compare_region + EXPORT_GUARD_SIZE + dest_offset, src + src_offset, size);
+    void *expected = e->kind == EXPORT_MEMPCPY ? dest + dest_offset + size : dest + dest_offset;
+    int passed = 1;
+    if (call_export(e, func, dest + dest_offset, src + src_offset, c, size) != expected) {
+        printf("Validation failed: %s did not return %s.\n", e->symbol,
+            e->kind == EXPORT_MEMPCPY ? "the end of the destination" :
+            "the original destination address");
+        passed = 0;
+    }
+    if (memcmp(dest_region, compare_region, region + 8) != 0) {
+        printf("Validation failed (%s, source offset = %d, destination offset = %d, "
+            "size = %d).\n", e->symbol, src_offset, dest_offset, size);
+        passed = 0;
+    }
+    return passed;
+}
+
+static int do_validation_exports(const char *library) {
+    void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        printf("Unable to load %s: %s.\n", library, dlerror());
+        return 0;
+    }
+    int passed = 1;
+    for (int i = 0; i < sizeof(export) / sizeof(export[0]); i++) {
+        const export_t *e = &export[i];
+        void *func = dlsym(handle, e->symbol);
+        printf("%s:\n", e->symbol);
+        if (func == NULL) {
+            printf("Not exported.\n");
+            continue;
+        }
+        fflush(stdout);
+        int export_passed = 1;
+        int max_src_offset = e->kind >= EXPORT_MEMSET ? 0 : 7;
+        for (int s = 0; s <= EXPORT_MAX_SMALL_SIZE + NU_EXPORT_LARGE_SIZES; s++) {
+            int size = s <= EXPORT_MAX_SMALL_SIZE ? s :
+                export_large_size[s - EXPORT_MAX_SMALL_SIZE - 1];
+            for (int src_offset = 0; src_offset <= max_src_offset; src_offset += e->alignment)
+                for (int dest_offset = 0; dest_offset < 8; dest_offset += e->alignment)
+                    export_passed &= validate_export_call(e, func, size, src_offset,
+                        dest_offset);
+        }
+        if (export_passed)
+            printf("Passed.\n");
+        passed &= export_passed;
+    }
+    dlclose(handle);
+    return passed;
+}
+
+/*
+ * Dummy computation used to measure the overlap of asynchronous copies with
+ * compute work. The data set is small enough to stay in the L1 cache.
+ */
+static float compute_buffer[1024];
+static volatile float compute_result;
+
+static void do_compute(int units) {
+    float sum = 0;
+    for (int k = 0; k < units; k++)
+        for (int i = 0; i < 1024; i++)
+            sum = sum * 0.999f + compute_buffer[i];
+    compute_result = sum;
+}
+
+/*
+ * Measure the time of a compute + copy loop with synchronous copies and with
+ * copies performed asynchronously by the copy worker. When request_size is
+ * smaller than the block size, each block is submitted as a series of
+ * adjacent requests of that size.
+ */
+static void do_async_test(int block_size, int request_size) {
+    uint8_t *src = buffer_page;
+    uint8_t *dest = buffer_page + 16 * 1024 * 1024;
+    int nu_iterations = (64 * 1024 * 1024) / block_size;
+    if (nu_iterations > 4096)
+        nu_iterations = 4096;
+    for (int i = 0; i < 1024; i++)
+        compute_buffer[i] = (float)i / 1024;
+    clear_data_cache();
+    /* Copy only. */
+    memcpy_func(dest, src, block_size);
+    double start_time = get_time();
+    for (int i = 0; i < nu_iterations; i++)
+        memcpy_func(dest, src, block_size);
+    double copy_time = (get_time() - start_time) / nu_iterations;
+    /* Calibrate the amount of computation to match the copy time. */
+    int units = 1;
+    for (;;) {
+        start_time = get_time();
+        do_compute(units);
+        double t = get_time() - start_time;
+        if (t >= copy_time || units >= 1 << 20)
+            break;
+        units *= 2;
+    }
+    start_time = get_time();
+    for (int i = 0; i < nu_iterations; i++)
+        do_compute(units);
+    double compute_time = (get_time() - start_time) / nu_iterations;
+    /* Synchronous copy followed by computation. */
+    start_time = get_time();
+    for (int i = 0; i < nu_iterations; i++) {
+        for (int j = 0; j < block_size; j += request_size)
+            memcpy_func(dest + j, src + j, request_size);
+        do_compute(units);
+    }
+    double sync_time = (get_time() - start_time) / nu_iterations;
+    /* Asynchronous copy overlapped with computation. */
+    start_time = get_time();
+    for (int i = 0; i < nu_iterations; i++) {
+        fastarm_async_token_t token = 0;
+        for (int j = 0; j < block_size; j += request_size)
+            token = fastarm_async_memcpy(dest + j, src + j, request_size);
+        do_compute(units);
+        fastarm_async_wait(token);
+    }
+    double async_time = (get_time() - start_time) / nu_iterations;
+    double min_time = copy_time < compute_time ? copy_time : compute_time;
+    printf("%d bytes in requests of %d bytes: copy %.2lf us, compute %.2lf us, "
+        "sync %.2lf us, async %.2lf us, overlap %.1lf%%\n", block_size, request_size,
+        copy_time * 1000000.0, compute_time * 1000000.0, sync_time * 1000000.0,
+        async_time * 1000000.0, (sync_time - async_time) * 100.0 / min_time);
+}
+
+static void do_async_tests(int cpu) {
+    if (fastarm_async_init(cpu, memcpy_func) != 0) {
+        printf("Could not start the asynchronous copy worker.\n");
+        return;
+    }
+    do_async_test(4096, 4096);
+    do_async_test(32768, 32768);
+    do_async_test(256 * 1024, 256 * 1024);
+    do_async_test(1024 * 1024, 1024 * 1024);
+    do_async_test(4 * 1024 * 1024, 4 * 1024 * 1024);
+    do_async_test(32768, 128);
+    do_async_test(1024 * 1024, 4096);
+    fastarm_async_shutdown();
+}
+
+#define NU_BATCH_DESCRIPTORS 4096
+
+/*
+ * Descriptor sets modelling a serialization layer: many small copies of
+ * heterogeneous size from scattered sources into a packed destination.
+ */
+static void create_batch_descriptors(struct fastarm_copy_desc *d, int type) {
+    uint8_t *dest = buffer_page + 24 * 1024 * 1024;
+    for (int i = 0; i < NU_BATCH_DESCRIPTORS; i++) {
+        int size, source;
+        double f = (double)rand() / RAND_MAX;
+        switch (type) {
+        case 0 :
+        case 1 :
+            /* Sizes 1 to 256 (power law), randomly aligned. */
+            size = 1 + (int)floor(255.0 * (pow(2.0, 8.0 * f) - 1.0) / 255.0);
+            source = rand() % ((type == 0 ? 1024 * 1024 : 8 * 1024 * 1024) - 256);
+            break;
+        case 2 :
+            /* Word-aligned fields of 4 to 64 bytes. */
+            size = 4 + (rand() % 16) * 4;
+            source = (rand() % (1024 * 1024 - 64)) & (~3);
+            break;
+        default :
+            /* Mix of small fields and occasional larger blocks. */
+            if (f < 0.95)
+                size = 1 + rand() % 64;
+            else
+                size = 256 + rand() % 4096;
+            source = rand() % (8 * 1024 * 1024 - 4096 - 256);
+            break;
+        }
+        d[i].dest = dest;
+        d[i].src = buffer_page + source;
+        d[i].n = size;
+        dest += size;
+    }
+}
+
+static const char *batch_test_name[4] = {
+    "Up to 256 bytes power law, randomly aligned, sources in 1MB",
+    "Up to 256 bytes power law, randomly aligned, sources in 8MB (DRAM)",
+    "4 to 64 bytes word aligned, sources in 1MB",
+    "Mixed 1 to 64 bytes with 5% blocks of 256 to 4352 bytes (DRAM)"
+};
+
+#define NU_BATCH_METHODS 4
+
+static const char *batch_method_name[NU_BATCH_METHODS] = { "separate calls",
+    "fastarm_memcpy_batch", "fastarm_memcpy_gather", "fastarm_memcpy_scatter" };
+
+/* Returns the number of bytes copied by the gather and scatter methods. */
+
+static size_t do_batch_method(int method, const struct fastarm_copy_desc *d,
+const struct iovec *iov, const struct iovec *scatter_iov) {
+    if (method == 0)
+        for (int i = 0; i < NU_BATCH_DESCRIPTORS; i++)
+            memcpy_func(d[i].dest, d[i].src, d[i].n);
+    else if (method == 1)
+        fastarm_memcpy_batch(d, NU_BATCH_DESCRIPTORS);
+    else if (method == 2)
+        return fastarm_memcpy_gather(d[0].dest, iov, NU_BATCH_DESCRIPTORS);
+    else
+        return fastarm_memcpy_scatter(scatter_iov, NU_BATCH_DESCRIPTORS, buffer_page);
+    return 0;
+}
+
+/*
+ * Clear the destinations, perform the copies once and compare the result.
+ * The scatter copies the contiguous start of the buffer to destinations that
+ * are separated by gaps, the other methods copy to contiguous destinations.
+ */
+static int check_batch_method(int method, const struct fastarm_copy_desc *d,
+const struct iovec *iov, const struct iovec *scatter_iov, int bytes) {
+    if (method == 3) {
+        uint8_t *start = scatter_iov[0].iov_base;
+        const struct iovec *last = &scatter_iov[NU_BATCH_DESCRIPTORS - 1];
+        memset(start, 0, (uint8_t *)last->iov_base + last->iov_len - start);
+    }
+    else
+        memset(d[0].dest, 0, bytes);
+    size_t copied = do_batch_method(method, d, iov, scatter_iov);
+    if (method >= 2 && copied != bytes) {
+        printf("Validation failed (%s returned %d instead of %d).\n",
+            batch_method_name[method], (int)copied, bytes);
+        return 0;
+    }
+    const uint8_t *src = buffer_page;
+    for (int i = 0; i < NU_BATCH_DESCRIPTORS; i++) {
+        if (method == 3 ? memcmp(scatter_iov[i].iov_base, src, scatter_iov[i].iov_len) != 0 :
+        memcmp(d[i].dest, d[i].src, d[i].n) != 0) {
+            printf("Validation failed (%s, descriptor %d, size %d).\n",
+                batch_method_name[method], i, (int)d[i].n);
+            return 0;
+        }
+        src += d[i].n;
+    }
+    return 1;
+}
+
+static void do_batch_tests() {
+    struct fastarm_copy_desc *d = malloc(sizeof(struct fastarm_copy_desc) * NU_BATCH_DESCRIPTORS);
+    struct iovec *iov = malloc(sizeof(struct iovec) * NU_BATCH_DESCRIPTORS);
+    struct iovec *scatter_iov = malloc(sizeof(struct iovec) * NU_BATCH_DESCRIPTORS);
+    fastarm_memcpy_batch_set_func(memcpy_func);
+    for (int type = 0; type < 4; type++) {
+        create_batch_descriptors(d, type);
+        int bytes = 0;
+        uint8_t *scatter_dest = buffer_page + 28 * 1024 * 1024;
+        for (int i = 0; i < NU_BATCH_DESCRIPTORS; i++) {
+            iov[i].iov_base = (void *)d[i].src;
+            iov[i].iov_len = d[i].n;
+            bytes += d[i].n;
+            scatter_iov[i].iov_base = scatter_dest;
+            scatter_iov[i].iov_len = d[i].n;
+            scatter_dest += d[i].n + rand() % 64;
+        }
+        for (int method = 0; method < NU_BATCH_METHODS; method++) {
+            if (!check_batch_method(method, d, iov, scatter_iov, bytes))
+                continue;
+            clear_data_cache();
+            double start_time = get_time();
+            double end_time;
+            int count = 0;
+            for (;;) {
+                do_batch_method(method, d, iov, scatter_iov);
+                count++;
+                end_time = get_time();
+                if (end_time - start_time >= test_duration)
+                    break;
+            }
+            double t = end_time - start_time;
+            printf("%s (%s): %.2lf MB/s, %.1lf ns per copy\n", batch_test_name[type],
+                batch_method_name[method], (double)bytes * count / (1024 * 1024) / t,
+                t * 1000000000.0 / ((double)count * NU_BATCH_DESCRIPTORS));
+        }
+    }
+    free(d);
+    free(iov);
+    free(scatter_iov);
+}
+
+/*
+ * File copies (--filecopy). A source file is created in /dev/shm (tmpfs)
+ * and in the current directory (local disk) and copied to a buffer and to
+ * another file, with read() and write() loops and with the mapped copies of
+ * file_copy.c. Each copy is timed once with the source dropped from the page
+ * cache (which has no effect on tmpfs) and as the best of a few rounds with
+ * the source cached.
+ */
+
+#define FILE_COPY_TEST_SIZE (64 * 1024 * 1024)
+#define FILE_COPY_TEST_CHUNK_SIZE (128 * 1024)
+#define FILE_COPY_TEST_ROUNDS 3
+#define NU_FILE_COPY_METHODS 5
+
+static const char *file_copy_dir[2] = { "/dev/shm", "." };
+static const char *file_copy_dir_name[2] = { "tmpfs", "local disk" };
+static const char *file_copy_method_name[NU_FILE_COPY_METHODS] = {
+    "file to buffer, read() into a chunk and memcpy",
+    "file to buffer, read() directly",
+    "file to buffer, fastarm_copy_file_to_buffer",
+    "file to file, read()/write() loop",
+    "file to file, fastarm_copy_file_range"
+};
+
+/* Returns the number of bytes copied, or -1 on error. */
+static ssize_t file_copy_method(int method, int fd_in, int fd_out, uint8_t *dest,
+uint8_t *chunk) {
+    ssize_t total = 0;
+    if (method == 2)
+        return fastarm_copy_file_to_buffer(dest, fd_in, 0, FILE_COPY_TEST_SIZE);
+    if (method == 4)
+        return fastarm_copy_file_range(fd_in, 0, fd_out, 0, FILE_COPY_TEST_SIZE);
+    if (lseek(fd_in, 0, SEEK_SET) < 0 || (method == 3 && lseek(fd_out, 0, SEEK_SET) < 0))
+        return - 1;
+    for (;;) {
+        ssize_t r = read(fd_in, method == 1 ? dest + total : chunk, FILE_COPY_TEST_CHUNK_SIZE);
+        if (r < 0)
+            return - 1;
+        if (r == 0)
+            break;
+        if (method == 0)
+            memcpy_func(dest + total, chunk, r);
+        else if (method == 3 && write(fd_out, chunk, r) != r)
+            return - 1;
+        total += r;
+    }
+    return total;
+}
+
+static void do_file_copy_test(int dir, uint8_t *src, uint8_t *dest, uint8_t *chunk) {
+    char src_path[256], dest_path[256];
+    sprintf(src_path, "%s/benchmark_file_copy_src.tmp", file_copy_dir[dir]);
+    sprintf(dest_path, "%s/benchmark_file_copy_dest.tmp", file_copy_dir[dir]);
+    int fd_in = open(src_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int fd_out = open(dest_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_in < 0 || fd_out < 0 || write(fd_in, src, FILE_COPY_TEST_SIZE) !=
+    FILE_COPY_TEST_SIZE) {
+        printf("Unable to create the test files in %s.\n", file_copy_dir[dir]);
+        goto end;
+    }
+    fsync(fd_in);
+    for (int method = 0; method < NU_FILE_COPY_METHODS; method++) {
+        double t_uncached = 0, t_cached = 0;
+        int correct = 1;
+        for (int round = 0; round <= FILE_COPY_TEST_ROUNDS; round++) {
+            if (round == 0)
+                posix_fadvise(fd_in, 0, 0, POSIX_FADV_DONTNEED);
+            if (method >= 3 && ftruncate(fd_out, 0) != 0)
+                correct = 0;
+            memset(dest, 0, FILE_COPY_TEST_SIZE);
+            clear_data_cache();
+            double start_time = get_time();
+            ssize_t r = file_copy_method(method, fd_in, fd_out, dest, chunk);
+            double t = get_time() - start_time;
+            if (round == 0)
+                t_uncached = t;
+            else if (round == 1 || t < t_cached)
+                t_cached = t;
+            if (method >= 3 && r == FILE_COPY_TEST_SIZE)
+                r = pread(fd_out, dest, FILE_COPY_TEST_SIZE, 0);
+            if (r != FILE_COPY_TEST_SIZE || memcmp(dest, src, FILE_COPY_TEST_SIZE) != 0)
+                correct = 0;
+        }
+        printf("%s, %s: ", file_copy_dir_name[dir], file_copy_method_name[method]);
+        if (!correct)
+            printf("failed\n");
+        else
+            printf("%.2lf MB/s uncached, %.2lf MB/s cached\n",
+                FILE_COPY_TEST_SIZE / t_uncached / (1024 * 1024),
+                FILE_COPY_TEST_SIZE / t_cached / (1024 * 1024));
+    }
+end:
+    if (fd_in >= 0)
+        close(fd_in);
+    if (fd_out >= 0)
+        close(fd_out);
+    unlink(src_path);
+    unlink(dest_path);
+}
+
+static void do_file_copy_tests() {
+    uint8_t *src = malloc(FILE_COPY_TEST_SIZE);
+    uint8_t *dest = malloc(FILE_COPY_TEST_SIZE);
+    uint8_t *chunk = malloc(FILE_COPY_TEST_CHUNK_SIZE);
+    for (int i = 0; i < FILE_COPY_TEST_SIZE; i++)
+        src[i] = i * 13 + (i >> 16);
+    fastarm_copy_file_set_func(memcpy_func);
+    for (int dir = 0; dir < 2; dir++)
+        do_file_copy_test(dir, src, dest, chunk);
+    free(src);
+    free(dest);
+    free(chunk);
+}
+
+/*
+ * Cache and memory hierarchy characterization (--probe).
+ */
+
+#define PROBE_REGION_SIZE (16 * 1024 * 1024)
+#define PROBE_NU_SIZES 32
+#define PROBE_MAX_LEVELS 4
+
+static void * volatile probe_sink;
+
+static void shuffle_int(int *a, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+}
+
+/* Link the given addresses into a cyclic pointer chain in array order. */
+static void *link_chain(uint8_t **addr, int n) {
+    for (int i = 0; i < n; i++)
+        *(void **)addr[i] = addr[(i + 1) % n];
+    return addr[0];
+}
+
+/*
+ * Create a chain visiting nodes spaced by node_size bytes in a region of the
+ * given size. Pages are visited in random order and the nodes within a page
+ * in random order, which defeats the hardware prefetcher while keeping the
+ * number of TLB misses low.
+ */
+static void *create_random_chain(uint8_t *base, int size, int node_size, uint8_t **addr) {
+    int page_size = size < 4096 ? size : 4096;
+    int nu_pages = size / page_size;
+    int nodes_per_page = page_size / node_size;
+    int *page_order = malloc(sizeof(int) * nu_pages);
+    int *node_order = malloc(sizeof(int) * nodes_per_page);
+    for (int i = 0; i < nu_pages; i++)
+        page_order[i] = i;
+    shuffle_int(page_order, nu_pages);
+    int n = 0;
+    for (int i = 0; i < nu_pages; i++) {
+        for (int j = 0; j < nodes_per_page; j++)
+            node_order[j] = j;
+        shuffle_int(node_order, nodes_per_page);
+        for (int j = 0; j < nodes_per_page; j++)
+            addr[n++] = base + page_order[i] * page_size + node_order[j] * node_size;
+    }
+    free(page_order);
+    free(node_order);
+    return link_chain(addr, n);
+}
+
+/* Return the average time in seconds per step of following a pointer chain. */
+static double chase_chain(void *start, int nodes_per_step) {
+    int steps = 1 << 14;
+    for (;;) {
+        void **p = start;
+        double start_time = get_time();
+        for (int i = 0; i < steps; i += 8) {
+            p = *p; p = *p; p = *p; p = *p;
+            p = *p; p = *p; p = *p; p = *p;
+        }
+        double t = get_time() - start_time;
+        probe_sink = p;
+        if (t >= 0.05 || steps >= (1 << 26))
+            return t * nodes_per_step / steps;
+        steps *= 2;
+    }
+}
+
+/* Read through a region with software preloads at the given distance. */
+static double read_bandwidth_with_preload(const uint8_t *p, int size, int distance,
+int line_size) {
+    double start_time = get_time();
+    uint32_t sum = 0;
+    for (int k = 0; k < 4; k++) {
+        for (int i = 0; i < size; i += 32) {
+            const uint32_t *q = (const uint32_t *)(p + i);
+            if (distance > 0 && (i & (line_size - 1)) == 0)
+                __builtin_prefetch(p + i + distance);
+            sum += q[0] + q[1] + q[2] + q[3] + q[4] + q[5] + q[6] + q[7];
+        }
+    }
+    double t = get_time() - start_time;
+    probe_sink = (void *)(uintptr_t)sum;
+    return (double)size * 4 / (1024 * 1024) / t;
+}
+
+static int cpu_has_neon() {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL)
+        return 0;
+    char line[1024];
+    int neon = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+        if (strncmp(line, "Features", 8) == 0 && strstr(line, " neon") != NULL)
+            neon = 1;
+    fclose(f);
+    return neon;
+}
+
+static int cpu_architecture() {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL)
+        return 0;
+    char line[1024];
+    int arch = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+        if (strncmp(line, "CPU architecture", 16) == 0 && strchr(line, ':') != NULL)
+            arch = atoi(strchr(line, ':') + 1);
+    fclose(f);
+    return arch;
+}
+
+/*
+ * Return whether the CPU implements the multiprocessing extensions (and thus
+ * PLDW). This is the case for all ARMv8 cores and for the ARMv7 Cortex-A5,
+ * A7, A9, A12, A15 and A17, but not for the Cortex-A8 or ARMv6 cores.
+ */
+static int cpu_has_mp_extensions() {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL)
+        return 0;
+    char line[1024];
+    int arch = 0, implementer = 0, part = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *value = strchr(line, ':');
+        if (value == NULL)
+            continue;
+        if (strncmp(line, "CPU architecture", 16) == 0)
+            arch = atoi(value + 1);
+        else if (strncmp(line, "CPU implementer", 15) == 0)
+            implementer = strtol(value + 1, NULL, 0);
+        else if (strncmp(line, "CPU part", 8) == 0)
+            part = strtol(value + 1, NULL, 0);
+    }
+    fclose(f);
+    if (arch >= 8)
+        return 1;
+    return arch == 7 && implementer == 0x41 && (part == 0xC05 || part == 0xC07 ||
+        part == 0xC09 || part == 0xC0D || part == 0xC0E || part == 0xC0F);
+}
+
+static void do_probe() {
+    uint8_t *base = buffer_page;
+    uint8_t **addr = malloc(sizeof(uint8_t *) * (PROBE_REGION_SIZE / 32));
+    /* Load latency as a function of the working set size. */
+    int size[PROBE_NU_SIZES];
+    double latency[PROBE_NU_SIZES];
+    int nu_sizes = 0;
+    for (int s = 4096; s <= PROBE_REGION_SIZE; s *= 2) {
+        size[nu_sizes++] = s;
+        if (s >= 8192 && s * 3 / 2 < PROBE_REGION_SIZE)
+            size[nu_sizes++] = s * 3 / 2 & ~4095;
+    }
+    printf("Load latency (random access within working set):\n");
+    for (int i = 0; i < nu_sizes; i++) {
+        void *start = create_random_chain(base, size[i], 32, addr);
+        latency[i] = chase_chain(start, 1);
+        printf("%8d KB: %6.2lf ns\n", size[i] / 1024, latency[i] * 1000000000.0);
+    }
+    /*
+     * A new level starts when the latency exceeds the maximum latency seen
+     * at the current level by 40%.
+     */
+    int level_size[PROBE_MAX_LEVELS];
+    double level_latency[PROBE_MAX_LEVELS];
+    int nu_levels = 0;
+    double plateau = latency[0];
+    level_latency[0] = latency[0];
+    for (int i = 1; i < nu_sizes; i++) {
+        if (latency[i] > plateau * 1.4 && nu_levels < PROBE_MAX_LEVELS - 1) {
+            level_size[nu_levels] = size[i - 1];
+            nu_levels++;
+            level_latency[nu_levels] = latency[i];
+            plateau = latency[i];
+        }
+        else if (latency[i] > plateau)
+            plateau = latency[i];
+    }
+    double dram_latency = latency[nu_sizes - 1];
+    for (int i = 0; i < nu_levels; i++)
+        printf("L%d: about %d KB, latency %.2lf ns\n", i + 1, level_size[i] / 1024,
+            level_latency[i] * 1000000000.0);
+    printf("DRAM latency: %.2lf ns\n", dram_latency * 1000000000.0);
+    for (int i = 0; i < PROBE_MAX_LEVELS; i++) {
+        char path[128], level[32], type[32], cache_size[32], line[32];
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!read_sysfs_value(path, level, sizeof(level)))
+            break;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        read_sysfs_value(path, type, sizeof(type));
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        read_sysfs_value(path, cache_size, sizeof(cache_size));
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", i);
+        read_sysfs_value(path, line, sizeof(line));
+        printf("(Reported by kernel: L%s %s cache of %s with line size %s)\n", level, type,
+            cache_size, line);
+    }
+
+    /*
+     * Effective line fill size. Blocks of 256 bytes in DRAM are visited in
+     * random order; in each block the word at offset 0 and the word at
+     * offset k are loaded. As long as k is within the fill triggered by the
+     * first load, the second load is cheap.
+     */
+    printf("Line fill size (second access at offset k within a block, DRAM):\n");
+    int nu_blocks = PROBE_REGION_SIZE / 256;
+    double t_pair[8];
+    int line_fill_size = 128;
+    int nu_k = 0;
+    for (int k = 8; k <= 128; k *= 2) {
+        create_random_chain(base, PROBE_REGION_SIZE, 256, addr);
+        for (int i = 0; i < nu_blocks; i++) {
+            *(void **)addr[i] = addr[i] + k;
+            *(void **)(addr[i] + k) = addr[(i + 1) % nu_blocks];
+        }
+        t_pair[nu_k] = chase_chain(addr[0], 2);
+        printf("k = %3d: %.2lf ns per block\n", k, t_pair[nu_k] * 1000000000.0);
+        if (t_pair[nu_k] > t_pair[0] * 1.5 && line_fill_size == 128)
+            line_fill_size = k;
+        nu_k++;
+    }
+
+    /*
+     * Hardware prefetcher reach. Follow a chain through DRAM in ascending
+     * address order with a fixed stride and compare with random access.
+     */
+    printf("Hardware prefetcher (sequential chain with stride, DRAM):\n");
+    int prefetch_reach = 0;
+    for (int stride = 32; stride <= 4096; stride *= 2) {
+        int n = PROBE_REGION_SIZE / stride;
+        for (int i = 0; i < n; i++)
+            addr[i] = base + i * stride;
+        void *start = link_chain(addr, n);
+        double t = chase_chain(start, 1);
+        int prefetched = t < dram_latency * 0.5;
+        printf("stride %4d: %6.2lf ns%s\n", stride, t * 1000000000.0,
+            prefetched ? " (prefetched)" : "");
+        if (prefetched && stride == prefetch_reach * 2)
+            prefetch_reach = stride;
+        if (prefetched && prefetch_reach == 0 && stride == 32)
+            prefetch_reach = stride;
+    }
+
+    /* Software preload distance for streaming reads from DRAM. */
+    printf("Software preload distance (streaming read from DRAM, line size %d):\n",
+        line_fill_size > 64 ? 64 : line_fill_size);
+    static const int distance[10] = { 0, 64, 96, 128, 192, 256, 320, 384, 512, 768 };
+    int best_distance = 0;
+    double best_bandwidth = 0, no_preload_bandwidth = 0;
+    for (int i = 0; i < 10; i++) {
+        clear_data_cache();
+        double bw = read_bandwidth_with_preload(base, PROBE_REGION_SIZE, distance[i],
+            line_fill_size > 64 ? 64 : line_fill_size);
+        printf("distance %3d: %.2lf MB/s\n", distance[i], bw);
+        if (i == 0)
+            no_preload_bandwidth = bw;
+        if (bw > best_bandwidth) {
+            best_bandwidth = bw;
+            best_distance = distance[i];
+        }
+    }
+    free(addr);
+
+    /* Recommendations. */
+    int line_size = line_fill_size >= 64 ? 64 : 32;
+    const char *platform;
+    if (cpu_architecture() == 6)
+        platform = "RPI";
+    else if (cpu_has_neon()) {
+        if (best_distance == 0 || best_bandwidth < no_preload_bandwidth * 1.05)
+            platform = "NEON_AUTO";
+        else
+            platform = line_size == 64 ? "NEON_64" : "NEON_32";
+    }
+    else
+        platform = line_size == 64 ? "ARMV7_64" : "ARMV7_32";
+    int largest_cache = nu_levels > 0 ? level_size[nu_levels - 1] : 1024 * 1024;
+    int flush_size = largest_cache * 4;
+    if (flush_size < 1024 * 1024)
+        flush_size = 1024 * 1024;
+    if (flush_size > 32 * 1024 * 1024)
+        flush_size = 32 * 1024 * 1024;
+    printf("\nRecommended settings:\n");
+    printf("PLATFORM = %s\n", platform);
+    printf("Preload line size: %d bytes\n", line_size);
+    if (best_distance > 0)
+        printf("Preload offset: %d bytes (%d lines)\n", best_distance, best_distance / line_size);
+    else
+        printf("Preload offset: none needed (hardware prefetcher reach %d bytes)\n",
+            prefetch_reach);
+    printf("Cache flush size: %d MB (--flush-size %d)\n", flush_size / (1024 * 1024),
+        flush_size / (1024 * 1024));
+}
+
+/*
+ * Measure the peak bandwidth of a streaming kernel over a buffer of the given
+ * size (for copies, the size of the source and of the destination). The best
+ * of three rounds of at least 0.1 seconds is returned.
+ */
+static double stream_bandwidth(int kind, int use_neon, uint8_t *buffer, int size) {
+    double best = 0;
+    for (int round = 0; round < 4; round++) {
+        double start_time = get_time();
+        double t;
+        int count = 0;
+        do {
+            if (kind == ROOFLINE_READ)
+                (use_neon ? stream_read_neon : stream_read_ldm)(buffer, size);
+            else if (kind == ROOFLINE_WRITE)
+                (use_neon ? stream_write_neon : stream_write_stm)(buffer, size);
+            else
+                (use_neon ? stream_copy_neon : stream_copy_ldm)(buffer + size, buffer, size);
+            count++;
+            t = get_time() - start_time;
+        } while (round > 0 && t < 0.1);
+        /* The first round only warms up the caches. */
+        double bandwidth = (double)size * count / (1024 * 1024) / t;
+        if (round > 0 && bandwidth > best)
+            best = bandwidth;
+    }
+    return best;
+}
+
+static void measure_roofline_peaks() {
+    for (int i = 0; i < 4; i++) {
+        char path[128], value[32], type[32];
+        int level;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!read_sysfs_int(path, &level))
+            break;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        read_sysfs_value(path, type, sizeof(type));
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if ((level == 1 && strcmp(type, "Data") == 0) || level == 2)
+            if (read_sysfs_value(path, value, sizeof(value)) && atoi(value) > 0)
+                roofline_cache_size[level - 1] = atoi(value) * 1024;
+    }
+    /*
+     * The working sets use half of a cache level (and at least four times
+     * the L1 for L2) and 16 MB for DRAM.
+     */
+    int working_set[ROOFLINE_NU_LEVELS];
+    working_set[ROOFLINE_L1] = roofline_cache_size[0] / 2;
+    working_set[ROOFLINE_L2] = roofline_cache_size[1] / 2;
+    if (working_set[ROOFLINE_L2] < roofline_cache_size[0] * 4)
+        working_set[ROOFLINE_L2] = roofline_cache_size[0] * 4;
+    working_set[ROOFLINE_DRAM] = 16 * 1024 * 1024;
+    int neon = cpu_has_neon();
+    printf("Peak bandwidth (MB/s, best of %s):\n", neon ? "NEON and LDM/STM" : "LDM/STM");
+    printf("%-5s %9s %9s %9s\n", "", "read", "write", "copy");
+    for (int level = 0; level < ROOFLINE_NU_LEVELS; level++) {
+        printf("%-5s", roofline_level_name[level]);
+        for (int kind = 0; kind < ROOFLINE_NU_KINDS; kind++) {
+            int size = working_set[level];
+            if (kind == ROOFLINE_COPY)
+                size /= 2;
+            size &= ~63;
+            double peak = stream_bandwidth(kind, 0, buffer_page, size);
+            if (neon) {
+                double neon_peak = stream_bandwidth(kind, 1, buffer_page, size);
+                if (neon_peak > peak)
+                    peak = neon_peak;
+            }
+            roofline_peak[level][kind] = peak;
+            printf(" %9.2lf", peak);
+        }
+        printf("  (%d KB)\n", working_set[level] / 1024);
+    }
+    printf("\n");
+}
+
+#define NU_TESTS 48
+
+/*
+ * When alignment is non-zero, the test guarantees that the source and
+ * destination are aligned to at least alignment bytes and that the size is a
+ * multiple of 16, so that variants with an alignment contract can be run.
+ */
+
+typedef struct {
+    const char *name;
+    void (*test_func)();
+    int bytes;
+    int alignment;
+} test_t;
+
+static test_t test[NU_TESTS] = {
+    { "Mixed powers of 2 from 4 to 4096 (power law), word aligned", test_mixed_powers_of_two_word_aligned, 32768 },
+    { "Mixed multiples of 4 from 4 to 1024 (power law), word aligned", test_mixed_power_law_word_aligned, 32768 },
+    { "Mixed from 1 to 1023 (power law), unaligned", test_mixed_power_law_unaligned, 32768 },
+    { "4 bytes word aligned", test_aligned_4, 4 },
+    { "8 bytes word aligned", test_aligned_8, 8 },
+    { "16 bytes word aligned", test_aligned_16, 16 },
+    { "28 bytes word aligned", test_aligned_28, 28 },
+    { "32 bytes word aligned", test_aligned_32, 32 },
+    { "64 bytes word aligned", test_aligned_64, 64 },
+    { "128 bytes word aligned", test_aligned_128, 128 },
+    { "256 bytes word aligned", test_aligned_256, 256 },
+    { "3 bytes randomly aligned", test_unaligned_random_3, 3 },
+    { "8 bytes randomly aligned", test_unaligned_random_8, 8 },
+    { "17 bytes randomly aligned", test_unaligned_random_17, 17 },
+    { "28 bytes randomly aligned", test_unaligned_random_28, 28 },
+    { "64 bytes randomly aligned", test_unaligned_random_64, 64 },
+    { "137 bytes randomly aligned", test_unaligned_random_137, 137 },
+    { "1024 bytes randomly aligned", test_unaligned_random_1024, 1024 },
+    { "32768 bytes randomly aligned", test_unaligned_random_32768, 32768 },
+    { "1M bytes randomly aligned", test_unaligned_random_1M, 1024 * 1024 },
+    { "64 bytes randomly aligned, source aligned with dest",
+        test_source_dest_aligned_random_64, 64 },
+    { "1024 bytes randomly aligned, source aligned with dest",
+        test_source_dest_aligned_random_1024, 1024 },
+    { "32768 bytes randomly aligned, source aligned with dest",
+        test_source_dest_aligned_random_32768, 32768 },
+    { "1M bytes randomly aligned, source aligned with dest",
+        test_source_dest_aligned_random_1M, 1024 *1024 },
+    { "Up to 1024 bytes randomly aligned", test_random_mixed_sizes_1024, 512 },
+    { "Up to 64 bytes randomly aligned", test_random_mixed_sizes_64, 32 },
+    { "Up to 1024 bytes randomly aligned (DRAM)", test_random_mixed_sizes_DRAM_1024,
+       512 },
+    { "Up to 64 bytes randomly aligned (DRAM)", test_random_mixed_sizes_DRAM_64,
+       32 },
+    { "Up to 1024 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_1024,
+       514 },
+    { "Up to 256 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_256,
+       130 },
+    { "Up to 64 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_64,
+       34 },
+    { "28 bytes 4-byte aligned", test_word_aligned_28, 28 },
+    { "64 bytes 4-byte aligned", test_word_aligned_64, 64 },
+    { "296 bytes 4-byte aligned", test_word_aligned_296, 296 },
+    { "1024 bytes 4-byte aligned", test_word_aligned_1024, 1024 },
+    { "4096 bytes 4-byte aligned", test_word_aligned_4096, 4096 },
+    { "32768 bytes 4-byte aligned", test_word_aligned_32768, 32768 },
+    { "64 bytes 32-byte aligned", test_chunk_aligned_64, 64, 32 },
+    { "296 bytes 32-byte aligned", test_chunk_aligned_296, 296 },
+    { "1024 bytes 32-byte aligned", test_chunk_aligned_1024, 1024, 32 },
+    { "4096 bytes 32-byte aligned", test_chunk_aligned_4096, 4096, 32 },
+    { "32768 bytes 32-byte aligned", test_chunk_aligned_32768, 32768, 32 },
+    { "1024 bytes page aligned", test_page_aligned_1024, 1024, 4096 },
+    { "4096 bytes page aligned", test_page_aligned_4096, 4096, 4096 },
+    { "32768 bytes page aligned", test_page_aligned_32768, 32768, 4096 },
+    { "256K bytes page aligned", test_page_aligned_256K, 256 * 1024, 4096 },
+    { "1M bytes page aligned", test_page_aligned_1M, 1024 * 1024, 4096 },
+    { "8M bytes page aligned", test_page_aligned_8M, 8 * 1024 * 1024, 4096 },
+};
+
+#define NU_MEMSET_TESTS 25
+
+static test_t memset_test[NU_MEMSET_TESTS] = {
+    { "Mixed powers of 2 from 4 to 4096 (power law), word aligned", test_memset_mixed_powers_of_two_word_aligned, 2048 },
+    { "Mixed multiples of 4 from 4 to 1024 (power law), word aligned", test_memset_mixed_power_law_word_aligned, 512 },
+    { "Mixed from 1 to 1023 (power law), unaligned", test_memset_mixed_power_law_unaligned, 512 },
+    { "1024 bytes page aligned", test_memset_page_aligned_1024, 1024, 4096 },
+    { "4096 bytes page aligned", test_memset_page_aligned_4096, 4096, 4096 },
+    { "4 bytes word aligned", test_memset_aligned_4, 4 },
+    { "8 bytes word aligned", test_memset_aligned_8, 8 },
+    { "16 bytes word aligned", test_memset_aligned_16, 16 },
+    { "28 bytes word aligned", test_memset_aligned_28, 28 },
+    { "32 bytes word aligned", test_memset_aligned_32, 32 },
+    { "64 bytes word aligned", test_memset_aligned_64, 64 },
+    { "64 bytes various alignments word aligned (multi-test)", test_memset_various_aligned_64, 64 },
+    { "80 bytes word aligned", test_memset_aligned_80, 80 },
+    { "92 bytes word aligned", test_memset_aligned_92, 92 },
+    { "128 bytes word aligned", test_memset_aligned_128, 128 },
+    { "256 bytes word aligned", test_memset_aligned_256, 256 },
+    { "3 bytes randomly aligned", test_memset_unaligned_random_3, 3 },
+    { "8 bytes randomly aligned", test_memset_unaligned_random_8, 8 },
+    { "17 bytes randomly aligned", test_memset_unaligned_random_17, 17 },
+    { "28 bytes randomly aligned", test_memset_unaligned_random_28, 28 },
+    { "64 bytes randomly aligned", test_memset_unaligned_random_64, 64 },
+    { "137 bytes randomly aligned", test_memset_unaligned_random_137, 137 },
+    { "1023 bytes randomly aligned", test_memset_unaligned_random_1023, 1023 },
+    { "1M bytes page aligned", test_memset_page_aligned_1M, 1024 * 1024, 4096 },
+    { "8M bytes page aligned", test_memset_page_aligned_8M, 8 * 1024 * 1024, 4096 },
+};
+
+/*
+ * Declarative tests (--tests <file>). Each line of the file describes a test
+ * as a set of key=value fields:
+ *
+ * name="..."     Name of the test.
+ * op=<op>        memcpy (default) or memset.
+ * size=<dist>    Size distribution: fixed:<n>, uniform:<min>:<max>,
+ *                powerlaw:<min>:<max> (biased towards small sizes) or
+ *                histogram:<file> (lines of "<size> <weight>").
+ * align=<n>      Alignment of both source and destination (default 1).
+ * src_align=<n>, dst_align=<n> Alignment of the source or destination only.
+ * mutual_align=<n> Source and destination have the same misalignment modulo
+ *                <n> (but are otherwise randomly aligned).
+ * region=<r>     Size of the regions over which the sources and destinations
+ *                are spread: cache (64 KB), dram (8 MB) or a size in KB.
+ *                Default is cache.
+ *
+ * Empty lines and lines starting with # are ignored. Each test is compiled
+ * into an array of precomputed copies that the measurement loop cycles
+ * through.
+ */
+
+#define MAX_CUSTOM_TESTS 64
+#define CUSTOM_NU_DESCRIPTORS 1024
+#define CUSTOM_REGION_CACHE (64 * 1024)
+#define CUSTOM_REGION_DRAM (8 * 1024 * 1024)
+/* The source region starts at buffer_page, the destination region 16 MB later. */
+#define CUSTOM_MAX_REGION (16 * 1024 * 1024 - 4096)
+
+enum { SIZE_FIXED, SIZE_UNIFORM, SIZE_POWER_LAW, SIZE_HISTOGRAM };
+
+typedef struct {
+    int type;
+    int min, max;
+    int nu_bins;
+    int *bin_size;
+    double *bin_cumulative;
+} size_distribution_t;
+
+typedef struct {
+    uint8_t *dest;
+    const uint8_t *src;
+    int size;
+} test_descriptor_t;
+
+typedef struct {
+    char *name;
+    int is_memset;
+    size_distribution_t size;
+    int src_align, dst_align, mutual_align;
+    int region;
+    int bytes;
+    int alignment;
+    test_descriptor_t *desc;
+} custom_test_t;
+
+static custom_test_t custom_test[MAX_CUSTOM_TESTS];
+static int nu_custom_tests;
+static const test_descriptor_t *current_descriptor;
+
+static void test_custom_memcpy(int i) {
+    const test_descriptor_t *d = &current_descriptor[i & (CUSTOM_NU_DESCRIPTORS - 1)];
+    memcpy_func(d->dest, d->src, d->size);
+}
+
+static void test_custom_memset(int i) {
+    const test_descriptor_t *d = &current_descriptor[i & (CUSTOM_NU_DESCRIPTORS - 1)];
+    memset_func(d->dest, i & 0xFF, d->size);
+}
+
+static int is_power_of_two(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+static int load_histogram(size_distribution_t *dist, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return 0;
+    char line[256];
+    int capacity = 0;
+    double total = 0;
+    dist->nu_bins = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        int size;
+        double weight;
+        if (line[0] == '#' || sscanf(line, "%d %lf", &size, &weight) != 2)
+            continue;
+        if (size < 1 || size > CUSTOM_REGION_DRAM || weight < 0) {
+            fclose(f);
+            return 0;
+        }
+        if (dist->nu_bins == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            dist->bin_size = realloc(dist->bin_size, sizeof(int) * capacity);
+            dist->bin_cumulative = realloc(dist->bin_cumulative, sizeof(double) * capacity);
+        }
+        total += weight;
+        dist->bin_size[dist->nu_bins] = size;
+        dist->bin_cumulative[dist->nu_bins] = total;
+        dist->nu_bins++;
+    }
+    fclose(f);
+    if (dist->nu_bins == 0 || total <= 0)
+        return 0;
+    dist->min = dist->max = dist->bin_size[0];
+    for (int i = 0; i < dist->nu_bins; i++) {
+        dist->bin_cumulative[i] /= total;
+        if (dist->bin_size[i] < dist->min)
+            dist->min = dist->bin_size[i];
+        if (dist->bin_size[i] > dist->max)
+            dist->max = dist->bin_size[i];
+    }
+    return 1;
+}
+
+static int parse_size_distribution(size_distribution_t *dist, const char *value) {
+    memset(dist, 0, sizeof(size_distribution_t));
+    if (strncmp(value, "fixed:", 6) == 0) {
+        dist->type = SIZE_FIXED;
+        dist->min = dist->max = atoi(value + 6);
+    }
+    else if (strncmp(value, "histogram:", 10) == 0) {
+        dist->type = SIZE_HISTOGRAM;
+        return load_histogram(dist, value + 10);
+    }
+    else {
+        if (strncmp(value, "uniform:", 8) == 0)
+            dist->type = SIZE_UNIFORM;
+        else if (strncmp(value, "powerlaw:", 9) == 0)
+            dist->type = SIZE_POWER_LAW;
+        else
+            return 0;
+        if (sscanf(strchr(value, ':') + 1, "%d:%d", &dist->min, &dist->max) != 2)
+            return 0;
+    }
+    return dist->min >= 0 && dist->max >= dist->min && dist->max <= CUSTOM_REGION_DRAM;
+}
+
+static int sample_size(const size_distribution_t *dist) {
+    double f = (double)rand() / RAND_MAX;
+    switch (dist->type) {
+    case SIZE_UNIFORM :
+        return dist->min + rand() % (dist->max - dist->min + 1);
+    case SIZE_POWER_LAW :
+        return dist->min + (int)floor((dist->max - dist->min) *
+            (pow(2.0, 10.0 * f) - 1.0) / (pow(2.0, 10.0) - 1.0));
+    case SIZE_HISTOGRAM :
+        for (int i = 0; i < dist->nu_bins - 1; i++)
+            if (f <= dist->bin_cumulative[i])
+                return dist->bin_size[i];
+        return dist->bin_size[dist->nu_bins - 1];
+    default :
+        return dist->min;
+    }
+}
+
+/*
+ * Return the next key=value field of a line, or 0 at the end of the line.
+ * Values may be enclosed in double quotes.
+ */
+static int next_field(char **p, char **key, char **value) {
+    char *s = *p;
+    while (isspace(*s))
+        s++;
+    if (*s == '\0')
+        return 0;
+    *key = s;
+    while (*s != '\0' && *s != '=' && !isspace(*s))
+        s++;
+    if (*s != '=')
+        return - 1;
+    *s++ = '\0';
+    if (*s == '"') {
+        *value = ++s;
+        while (*s != '\0' && *s != '"')
+            s++;
+        if (*s != '"')
+            return - 1;
+    }
+    else {
+        *value = s;
+        while (*s != '\0' && !isspace(*s))
+            s++;
+    }
+    if (*s != '\0')
+        *s++ = '\0';
+    *p = s;
+    return 1;
+}
+
+static int parse_custom_test(custom_test_t *t, char *line) {
+    memset(t, 0, sizeof(custom_test_t));
+    t->src_align = t->dst_align = t->mutual_align = 1;
+    t->region = CUSTOM_REGION_CACHE;
+    int have_size = 0;
+    char *key, *value;
+    int r;
+    while ((r = next_field(&line, &key, &value)) == 1) {
+        if (strcmp(key, "name") == 0)
+            t->name = strdup(value);
+        else if (strcmp(key, "op") == 0) {
+            if (strcmp(value, "memcpy") != 0 && strcmp(value, "memset") != 0)
+                return 0;
+            t->is_memset = strcmp(value, "memset") == 0;
+        }
+        else if (strcmp(key, "size") == 0) {
+            if (!parse_size_distribution(&t->size, value))
+                return 0;
+            have_size = 1;
+        }
+        else if (strcmp(key, "align") == 0)
+            t->src_align = t->dst_align = atoi(value);
+        else if (strcmp(key, "src_align") == 0)
+            t->src_align = atoi(value);
+        else if (strcmp(key, "dst_align") == 0)
+            t->dst_align = atoi(value);
+        else if (strcmp(key, "mutual_align") == 0)
+            t->mutual_align = atoi(value);
+        else if (strcmp(key, "region") == 0) {
+            if (strcmp(value, "cache") == 0)
+                t->region = CUSTOM_REGION_CACHE;
+            else if (strcmp(value, "dram") == 0)
+                t->region = CUSTOM_REGION_DRAM;
+            else
+                t->region = atoi(value) * 1024;
+        }
+        else
+            return 0;
+    }
+    if (r < 0 || t->name == NULL || !have_size)
+        return 0;
+    if (!is_power_of_two(t->src_align) || !is_power_of_two(t->dst_align) ||
+    !is_power_of_two(t->mutual_align) || t->src_align > 4096 || t->dst_align > 4096 ||
+    t->mutual_align > 4096)
+        return 0;
+    return t->region >= t->size.max + 4096 && t->region <= CUSTOM_MAX_REGION;
+}
+
+static int load_custom_tests(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        printf("Unable to open %s.\n", filename);
+        return 0;
+    }
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        char *s = line;
+        while (isspace(*s))
+            s++;
+        if (*s == '\0' || *s == '#')
+            continue;
+        if (nu_custom_tests == MAX_CUSTOM_TESTS) {
+            printf("%s:%d: too many tests.\n", filename, line_number);
+            fclose(f);
+            return 0;
+        }
+        if (!parse_custom_test(&custom_test[nu_custom_tests], s)) {
+            printf("%s:%d: invalid test description.\n", filename, line_number);
+            fclose(f);
+            return 0;
+        }
+        nu_custom_tests++;
+    }
+    fclose(f);
+    if (nu_custom_tests == 0) {
+        printf("No tests in %s.\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/* Return a random offset in the region that is aligned to align bytes. */
+static int random_offset(int region, int size, int align) {
+    return (rand() % (region - size + 1)) & ~(align - 1);
+}
+
+/*
+ * Generate the descriptors of a test. Sets the average size and the alignment
+ * guaranteed by the test (only when all sizes are multiples of 16).
+ */
+static void compile_custom_test(custom_test_t *t) {
+    uint8_t *dest_region = buffer_page + 16 * 1024 * 1024;
+    double total = 0;
+    int multiple_of_16 = 1;
+    t->desc = malloc(sizeof(test_descriptor_t) * CUSTOM_NU_DESCRIPTORS);
+    for (int i = 0; i < CUSTOM_NU_DESCRIPTORS; i++) {
+        test_descriptor_t *d = &t->desc[i];
+        d->size = sample_size(&t->size);
+        int src = random_offset(t->region - 4096, d->size, t->src_align);
+        int dest = random_offset(t->region - 4096, d->size, t->dst_align);
+        if (t->mutual_align > 1)
+            dest = (dest & ~(t->mutual_align - 1)) + (src & (t->mutual_align - 1));
+        d->src = buffer_page + src;
+        d->dest = dest_region + dest;
+        total += d->size;
+        if (d->size & 15)
+            multiple_of_16 = 0;
+    }
+    t->bytes = (int)(total / CUSTOM_NU_DESCRIPTORS + 0.5);
+    t->alignment = 0;
+    if (multiple_of_16 && t->mutual_align == 1)
+        t->alignment = t->is_memset || t->dst_align < t->src_align ? t->dst_align :
+            t->src_align;
+}
+
+static void run_custom_tests(int memcpy_specified, int memset_specified, int repeat) {
+    for (int i = 0; i < nu_custom_tests; i++) {
+        custom_test_t *t = &custom_test[i];
+        if (t->is_memset ? !memset_specified : !memcpy_specified)
+            continue;
+        compile_custom_test(t);
+        current_descriptor = t->desc;
+        run_test(t->name, t->is_memset ? test_custom_memset : test_custom_memcpy, t->bytes,
+            t->alignment, t->is_memset, repeat, do_test);
+    }
+}
+
+/*
+ * Scenario tests modeled on real callers. Each call of a scenario function
+ * performs one application-level operation, which may consist of several
+ * memcpy calls, using a buffer reuse pattern similar to that of the caller.
+ */
+
+#define SCENARIO_FRAME_WIDTH 1920
+#define SCENARIO_FRAME_HEIGHT 1080
+#define SCENARIO_FRAME_STRIDE (SCENARIO_FRAME_WIDTH * 4)
+#define SCENARIO_FRAME_SIZE (SCENARIO_FRAME_STRIDE * SCENARIO_FRAME_HEIGHT)
+#define SCENARIO_VECTOR_ARENA_SIZE (4 * 1024 * 1024)
+#define SCENARIO_VECTOR_MAX_CAPACITY 32768
+#define SCENARIO_PACKET_SIZE 1500
+#define SCENARIO_PACKET_SLOT_SIZE 2048
+#define SCENARIO_NU_PACKET_SLOTS 256
+#define SCENARIO_NU_PACKET_DESTS 64
+#define SCENARIO_NU_RECTS 256
+
+typedef struct {
+    int x, y, w, h;
+} rect_t;
+
+static rect_t damage_rect[SCENARIO_NU_RECTS];
+static int vector_arena_offset;
+
+/*
+ * Growth of a std::vector-like array to 32 KB by doubling the capacity,
+ * copying the contents to a newly allocated block from a heap arena each
+ * time the capacity is exceeded.
+ */
+static void scenario_vector_growth(int i) {
+    uint8_t *data = buffer_page + vector_arena_offset;
+    for (int capacity = 16; capacity < SCENARIO_VECTOR_MAX_CAPACITY; capacity *= 2) {
+        vector_arena_offset += capacity;
+        if (vector_arena_offset + capacity * 2 > SCENARIO_VECTOR_ARENA_SIZE)
+            vector_arena_offset = 0;
+        uint8_t *new_data = buffer_page + vector_arena_offset;
+        memcpy_func(new_data, data, capacity);
+        data = new_data;
+    }
+}
+
+/*
+ * Copy of a 1500-byte packet from a receive ring of buffers to one of a set
+ * of application buffers.
+ */
+static void scenario_mtu_packet(int i) {
+    uint8_t *ring = buffer_page + 8 * 1024 * 1024;
+    uint8_t *app = buffer_page + 12 * 1024 * 1024;
+    memcpy_func(app + (i & (SCENARIO_NU_PACKET_DESTS - 1)) * SCENARIO_PACKET_SLOT_SIZE,
+        ring + (i & (SCENARIO_NU_PACKET_SLOTS - 1)) * SCENARIO_PACKET_SLOT_SIZE,
+        SCENARIO_PACKET_SIZE);
+}
+
+/* Copy of a complete 1920x1080 32bpp frame. */
+static void scenario_frame(int i) {
+    memcpy_func(buffer_page + 16 * 1024 * 1024, buffer_page, SCENARIO_FRAME_SIZE);
+}
+
+static const int struct_size[8] = { 12, 24, 40, 64, 16, 32, 8, 48 };
+
+/* Eight copies of small structures between locations on the stack. */
+static void scenario_small_structs(int i) {
+    uint8_t stack_buffer[1024] __attribute__((aligned(8)));
+    for (int k = 0; k < 8; k++)
+        memcpy_func(stack_buffer + 512 + k * 64, stack_buffer + ((k + i) & 7) * 64,
+            struct_size[k]);
+    /* Prevent the stack buffer from being optimized away. */
+    __asm__ volatile ("" : : "r" (stack_buffer) : "memory");
+}
+
+/*
+ * Blit of a damage rectangle from a back buffer to the front buffer, one
+ * memcpy per row, as done by X and Wayland compositors.
+ */
+static void scenario_damage_rect(int i) {
+    const rect_t *r = &damage_rect[i & (SCENARIO_NU_RECTS - 1)];
+    uint8_t *front = buffer_page + r->y * SCENARIO_FRAME_STRIDE + r->x * 4;
+    uint8_t *back = front + 16 * 1024 * 1024;
+    for (int y = 0; y < r->h; y++)
+        memcpy_func(front + y * SCENARIO_FRAME_STRIDE, back + y * SCENARIO_FRAME_STRIDE,
+            r->w * 4);
+}
+
+#define NU_SCENARIOS 5
+
+static test_t scenario[NU_SCENARIOS] = {
+    { "vector growth to 32 KB by doubling", scenario_vector_growth,
+        SCENARIO_VECTOR_MAX_CAPACITY - 16 },
+    { "1500-byte packet from ring of buffers", scenario_mtu_packet, SCENARIO_PACKET_SIZE },
+    { "1920x1080x4 frame copy", scenario_frame, SCENARIO_FRAME_SIZE },
+    { "8 small struct copies on the stack", scenario_small_structs, 244 },
+    { "damage rectangle blit (row by row)", scenario_damage_rect, 0 },
+};
+
+/*
+ * Create the damage rectangles. Most are small (text cursors, widgets),
+ * some are large (window contents). Sets the average number of bytes
+ * copied per blit.
+ */
+static void create_damage_rects() {
+    int total_bytes = 0;
+    for (int i = 0; i < SCENARIO_NU_RECTS; i++) {
+        rect_t *r = &damage_rect[i];
+        if ((rand() & 7) == 0) {
+            r->w = 200 + rand() % 601;
+            r->h = 100 + rand() % 401;
+        }
+        else {
+            r->w = 4 + rand() % 61;
+            r->h = 8 + rand() % 41;
+        }
+        r->x = rand() % (SCENARIO_FRAME_WIDTH - r->w + 1);
+        r->y = rand() % (SCENARIO_FRAME_HEIGHT - r->h + 1);
+        total_bytes += r->w * r->h * 4;
+    }
+    scenario[4].bytes = total_bytes / SCENARIO_NU_RECTS;
+}
+
+/*
+ * Differential copy (--diff). Two source images that differ in a given
+ * fraction of their lines are copied to the destination alternately, so that
+ * every copy changes that fraction of the lines of the destination. The time
+ * per copy of fastarm_memcpy_diff is compared with a full copy by the memcpy
+ * variant. fastarm_memcpy_diff is first validated for odd sizes and offsets.
+ */
+
+#define DIFF_NU_RATES 4
+
+static const double diff_change_rate[DIFF_NU_RATES] = { 0, 0.01, 0.1, 1.0 };
+
+static int count_bits(const unsigned int *bitmap, int nu_bits) {
+    int count = 0;
+    for (int i = 0; i < nu_bits; i++)
+        count += (bitmap[i / 32] >> (i & 31)) & 1;
+    return count;
+}
+
+static void do_diff_test(const char *name, int size, double rate) {
+    uint8_t *src[2] = { buffer_page, buffer_page + 8 * 1024 * 1024 };
+    uint8_t *dest = buffer_page + 16 * 1024 * 1024;
+    unsigned int *bitmap = malloc(sizeof(unsigned int) * FASTARM_MEMCPY_DIFF_BITMAP_WORDS(size));
+    int nu_lines = (size + FASTARM_MEMCPY_DIFF_LINE_SIZE - 1) / FASTARM_MEMCPY_DIFF_LINE_SIZE;
+    int nu_changed = (int)floor(rate * nu_lines + 0.5);
+    int *line = malloc(sizeof(int) * nu_lines);
+    for (int i = 0; i < size; i++)
+        src[0][i] = rand();
+    memcpy(src[1], src[0], size);
+    for (int i = 0; i < nu_lines; i++)
+        line[i] = i;
+    shuffle_int(line, nu_lines);
+    for (int i = 0; i < nu_changed; i++) {
+        int offset = line[i] * FASTARM_MEMCPY_DIFF_LINE_SIZE;
+        int length = size - offset < FASTARM_MEMCPY_DIFF_LINE_SIZE ? size - offset :
+            FASTARM_MEMCPY_DIFF_LINE_SIZE;
+        src[1][offset + rand() % length] ^= 0xFF;
+    }
+    memcpy(dest, src[0], size);
+    for (int k = 1; k >= 0; k--) {
+        int written = fastarm_memcpy_diff(dest, src[k], size, bitmap);
+        if (written != nu_changed || count_bits(bitmap, nu_lines) != nu_changed ||
+        memcmp(dest, src[k], size) != 0) {
+            printf("%s, %d%% of lines changed: fastarm_memcpy_diff is incorrect.\n", name,
+                (int)(rate * 100.0));
+            goto end;
+        }
+    }
+    for (int method = 0; method < 2; method++) {
+        clear_data_cache();
+        double start_time = get_time();
+        double end_time;
+        int count = 0;
+        for (;;) {
+            if (method == 0)
+                memcpy_func(dest, src[(count + 1) & 1], size);
+            else
+                fastarm_memcpy_diff(dest, src[(count + 1) & 1], size, bitmap);
+            count++;
+            end_time = get_time();
+            if (end_time - start_time >= test_duration)
+                break;
+        }
+        double t = end_time - start_time;
+        printf("%s, %d%% of lines changed (%s): %.2lf us per copy, %.2lf MB/s\n", name,
+            (int)(rate * 100.0), method == 0 ? "full copy" : "fastarm_memcpy_diff",
+            t * 1000000.0 / count, (double)size * count / (1024 * 1024) / t);
+    }
+end:
+    free(line);
+    free(bitmap);
+}
+
+/*
+ * Check fastarm_memcpy_diff for a size and source and destination offsets.
+ * Each line of the destination differs from the source with a probability of
+ * one half. The destination, the bytes around it, the return value and the
+ * bitmap (including the bits past the last line) are compared with the
+ * expected result.
+ */
+
+#define DIFF_GUARD_SIZE 64
+
+static int validate_diff(int size, int src_offset, int dest_offset) {
+    uint8_t *src = buffer_page + src_offset;
+    uint8_t *expected = buffer_page + 8 * 1024 * 1024 + dest_offset;
+    uint8_t *dest = buffer_page + 16 * 1024 * 1024 + dest_offset;
+    int nu_lines = (size + FASTARM_MEMCPY_DIFF_LINE_SIZE - 1) / FASTARM_MEMCPY_DIFF_LINE_SIZE;
+    int nu_words = FASTARM_MEMCPY_DIFF_BITMAP_WORDS(size);
+    unsigned int *bitmap = malloc(sizeof(unsigned int) * (nu_words + 1));
+    uint8_t *changed = malloc(nu_lines + 1);
+    int nu_changed = 0;
+    for (int i = 0; i < size; i++)
+        src[i] = rand();
+    for (int i = - DIFF_GUARD_SIZE; i < size + DIFF_GUARD_SIZE; i++)
+        expected[i] = i >= 0 && i < size ? src[i] : rand();
+    for (int i = 0; i < nu_lines; i++) {
+        changed[i] = rand() & 1;
+        nu_changed += changed[i];
+    }
+    /* Fill the destination with the expected result, then change the lines. */
+    memcpy(dest - DIFF_GUARD_SIZE, expected - DIFF_GUARD_SIZE, size + 2 * DIFF_GUARD_SIZE);
+    for (int i = 0; i < nu_lines; i++)
+        if (changed[i]) {
+            int offset = i * FASTARM_MEMCPY_DIFF_LINE_SIZE;
+            int length = size - offset < FASTARM_MEMCPY_DIFF_LINE_SIZE ? size - offset :
+                FASTARM_MEMCPY_DIFF_LINE_SIZE;
+            dest[offset + rand() % length] ^= 0xFF;
+        }
+    bitmap[nu_words] = 0xDEADBEEF;
+    int written = fastarm_memcpy_diff(dest, src, size, bitmap);
+    int passed = written == nu_changed && bitmap[nu_words] == 0xDEADBEEF &&
+        memcmp(dest - DIFF_GUARD_SIZE, expected - DIFF_GUARD_SIZE,
+        size + 2 * DIFF_GUARD_SIZE) == 0;
+    for (int i = 0; i < nu_words * 32; i++)
+        if (((bitmap[i / 32] >> (i & 31)) & 1) != (i < nu_lines && changed[i]))
+            passed = 0;
+    if (!passed)
+        printf("fastarm_memcpy_diff is incorrect (size = %d, source offset = %d, "
+            "destination offset = %d).\n", size, src_offset, dest_offset);
+    free(changed);
+    free(bitmap);
+    return passed;
+}
+
+/*
+ * Sizes that are not a multiple of the line size exercise the partial last
+ * line, and small sizes and unaligned starts the paths that do not use NEON.
+ */
+
+static const int diff_validation_size[] = { 0, 1, 3, 31, 32, 33, 63, 95, 127, 255, 1000,
+    4097, 65535 };
+
+static void do_diff_validation() {
+    int passed = 1;
+    for (int i = 0; i < sizeof(diff_validation_size) / sizeof(diff_validation_size[0]); i++)
+        for (int src_offset = 0; src_offset < 8; src_offset++)
+            for (int dest_offset = 0; dest_offset < 8; dest_offset++)
+                passed &= validate_diff(diff_validation_size[i], src_offset, dest_offset);
+    for (int i = 0; i < 100; i++)
+        passed &= validate_diff(rand() % 100000, rand() % 64, rand() % 64);
+    if (passed)
+        printf("fastarm_memcpy_diff: odd sizes and unaligned source and destination passed.\n");
+}
+
+static void do_diff_tests() {
+    do_diff_validation();
+    for (int i = 0; i < DIFF_NU_RATES; i++)
+        do_diff_test("64 KB state block", 64 * 1024, diff_change_rate[i]);
+    for (int i = 0; i < DIFF_NU_RATES; i++)
+        do_diff_test("1920x1080x4 frame", SCENARIO_FRAME_SIZE, diff_change_rate[i]);
+}
+
+/*
+ * Pattern fills (--pattern). fastarm_memset16/32/64 and fastarm_memset_pattern
+ * are compared with scalar store loops (and wmemset for 32-bit values) for a
+ * word aligned and a byte aligned destination. With --validate, the fills are
+ * validated instead for random destinations, sizes and patterns.
+ */
+
+#define PATTERN_NU_SIZES 4
+#define PATTERN_MAX_LEN 40
+
+static const int pattern_size[PATTERN_NU_SIZES] = { 64, 1024, 16 * 1024, 1024 * 1024 };
+
+typedef void *(*pattern_fill_func_type)(void *dest, const uint8_t *pattern, int pattern_len,
+    int size);
+
+static void *fastarm_fill16(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    return fastarm_memset16(dest, pattern[0] | (pattern[1] << 8), size / 2);
+}
+
+static void *fastarm_fill32(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint32_t v;
+    memcpy(&v, pattern, 4);
+    return fastarm_memset32(dest, v, size / 4);
+}
+
+static void *fastarm_fill64(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint64_t v;
+    memcpy(&v, pattern, 8);
+    return fastarm_memset64(dest, v, size / 8);
+}
+
+static void *fastarm_fill_pattern64(void *dest, const uint8_t *pattern, int pattern_len,
+int size) {
+    uint64_t v;
+    memcpy(&v, pattern, 8);
+    return fastarm_memset_pattern64(dest, size, v);
+}
+
+static void *fastarm_fill_pattern(void *dest, const uint8_t *pattern, int pattern_len,
+int size) {
+    return fastarm_memset_pattern(dest, pattern, pattern_len, size);
+}
+
+/* Element stores through memcpy, which are allowed to be unaligned. */
+
+static void *scalar_fill16(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint16_t v;
+    memcpy(&v, pattern, 2);
+    for (int i = 0; i < size; i += 2)
+        memcpy((uint8_t *)dest + i, &v, 2);
+    return dest;
+}
+
+static void *scalar_fill32(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint32_t v;
+    memcpy(&v, pattern, 4);
+    for (int i = 0; i < size; i += 4)
+        memcpy((uint8_t *)dest + i, &v, 4);
+    return dest;
+}
+
+static void *scalar_fill64(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint64_t v;
+    memcpy(&v, pattern, 8);
+    for (int i = 0; i < size; i += 8)
+        memcpy((uint8_t *)dest + i, &v, 8);
+    return dest;
+}
+
+static void *scalar_fill_pattern(void *dest, const uint8_t *pattern, int pattern_len,
+int size) {
+    int j = 0;
+    for (int i = 0; i < size; i++) {
+        ((uint8_t *)dest)[i] = pattern[j];
+        j++;
+        if (j == pattern_len)
+            j = 0;
+    }
+    return dest;
+}
+
+/* wmemset requires a wchar_t aligned destination. */
+static void *wmemset_fill32(void *dest, const uint8_t *pattern, int pattern_len, int size) {
+    uint32_t v;
+    memcpy(&v, pattern, 4);
+    return wmemset(dest, (wchar_t)v, size / sizeof(wchar_t));
+}
 
 typedef struct {
     const char *name;
-    void (*test_func)();
-    int bytes;
-} test_t;
+    /* Pattern length in bytes; sizes are a multiple of it except for pattern fills. */
+    int pattern_len;
+    int is_pattern;
+    pattern_fill_func_type fastarm_func;
+    pattern_fill_func_type scalar_func;
+    pattern_fill_func_type library_func;
+    const char *library_name;
+} pattern_fill_t;
 
-static test_t test[NU_TESTS] = {
-    { "Mixed powers of 2 from 4 to 4096 (power law), word aligned", test_mixed_powers_of_two_word_aligned, 32768 },
-    { "Mixed multiples of 4 from 4 to 1024 (power law), word aligned", test_mixed_power_law_word_aligned, 32768 },
-    { "Mixed from 1 to 1023 (power law), unaligned", test_mixed_power_law_unaligned, 32768 },
-    { "4 bytes word aligned", test_aligned_4, 4 },
-    { "8 bytes word aligned", test_aligned_8, 8 },
-    { "16 bytes word aligned", test_aligned_16, 16 },
-    { "28 bytes word aligned", test_aligned_28, 28 },
-    { "32 bytes word aligned", test_aligned_32, 32 },
-    { "64 bytes word aligned", test_aligned_64, 64 },
-    { "128 bytes word aligned", test_aligned_128, 128 },
-    { "256 bytes word aligned", test_aligned_256, 256 },
-    { "3 bytes randomly aligned", test_unaligned_random_3, 3 },
-    { "8 bytes randomly aligned", test_unaligned_random_8, 8 },
-    { "17 bytes randomly aligned", test_unaligned_random_17, 17 },
-    { "28 bytes randomly aligned", test_unaligned_random_28, 28 },
-    { "64 bytes randomly aligned", test_unaligned_random_64, 64 },
-    { "137 bytes randomly aligned", test_unaligned_random_137, 137 },
-    { "1024 bytes randomly aligned", test_unaligned_random_1024, 1024 },
-    { "32768 bytes randomly aligned", test_unaligned_random_32768, 32768 },
-    { "1M bytes randomly aligned", test_unaligned_random_1M, 1024 * 1024 },
-    { "64 bytes randomly aligned, source aligned with dest",
-        test_source_dest_aligned_random_64, 64 },
-    { "1024 bytes randomly aligned, source aligned with dest",
-        test_source_dest_aligned_random_1024, 1024 },
-    { "32768 bytes randomly aligned, source aligned with dest",
-        test_source_dest_aligned_random_32768, 32768 },
-    { "1M bytes randomly aligned, source aligned with dest",
-        test_source_dest_aligned_random_1M, 1024 *1024 },
-    { "Up to 1024 bytes randomly aligned", test_random_mixed_sizes_1024, 512 },
-    { "Up to 64 bytes randomly aligned", test_random_mixed_sizes_64, 32 },
-    { "Up to 1024 bytes randomly aligned (DRAM)", test_random_mixed_sizes_DRAM_1024,
-       512 },
-    { "Up to 64 bytes randomly aligned (DRAM)", test_random_mixed_sizes_DRAM_64,
-       32 },
-    { "Up to 1024 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_1024,
-       514 },
-    { "Up to 256 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_256,
-       130 },
-    { "Up to 64 bytes word aligned (DRAM)", test_random_mixed_sizes_DRAM_word_aligned_64,
-       34 },
-    { "28 bytes 4-byte aligned", test_word_aligned_28, 28 },
-    { "64 bytes 4-byte aligned", test_word_aligned_64, 64 },
-    { "296 bytes 4-byte aligned", test_word_aligned_296, 296 },
-    { "1024 bytes 4-byte aligned", test_word_aligned_1024, 1024 },
-    { "4096 bytes 4-byte aligned", test_word_aligned_4096, 4096 },
-    { "32768 bytes 4-byte aligned", test_word_aligned_32768, 32768 },
-    { "64 bytes 32-byte aligned", test_chunk_aligned_64, 64 },
-    { "296 bytes 32-byte aligned", test_chunk_aligned_296, 296 },
-    { "1024 bytes 32-byte aligned", test_chunk_aligned_1024, 1024 },
-    { "4096 bytes 32-byte aligned", test_chunk_aligned_4096, 4096 },
-    { "32768 bytes 32-byte aligned", test_chunk_aligned_32768, 32768 },
-    { "1024 bytes page aligned", test_page_aligned_1024, 1024 },
-    { "4096 bytes page aligned", test_page_aligned_4096, 4096 },
-    { "32768 bytes page aligned", test_page_aligned_32768, 32768 },
-    { "256K bytes page aligned", test_page_aligned_256K, 256 * 1024 },
-    { "1M bytes page aligned", test_page_aligned_1M, 1024 * 1024 },
-    { "8M bytes page aligned", test_page_aligned_8M, 8 * 1024 * 1024 },
+#define NU_PATTERN_FILLS 5
+
+static const pattern_fill_t pattern_fill[NU_PATTERN_FILLS] = {
+    { "fastarm_memset16", 2, 0, fastarm_fill16, scalar_fill16, NULL, NULL },
+    { "fastarm_memset32", 4, 0, fastarm_fill32, scalar_fill32, wmemset_fill32, "wmemset" },
+    { "fastarm_memset64", 8, 0, fastarm_fill64, scalar_fill64, NULL, NULL },
+    { "fastarm_memset_pattern64", 8, 1, fastarm_fill_pattern64, scalar_fill_pattern, NULL,
+      NULL },
+    /* A 24-bit RGB pixel. The length is random during validation. */
+    { "fastarm_memset_pattern", 3, 1, fastarm_fill_pattern, scalar_fill_pattern, NULL, NULL },
+};
+
+/* Returns 1 when the fill of size bytes at buffer_page + dest is correct. */
+static int validate_pattern_fill(const pattern_fill_t *fill, const uint8_t *pattern,
+int pattern_len, int dest, int size) {
+    int passed = 1;
+    fill_buffer(buffer_compare);
+    scalar_fill_pattern(buffer_compare + dest, pattern, pattern_len, size);
+    fill_buffer(buffer_page);
+    if (fill->fastarm_func(buffer_page + dest, pattern, pattern_len, size) !=
+    buffer_page + dest) {
+        printf("Validation failed: function did not return original destination address.\n");
+        passed = 0;
+    }
+    if (!compare_buffers(buffer_page, buffer_compare)) {
+        printf("Validation failed (destination offset = 0x%08X, pattern length = %d, "
+            "size = %d).\n", dest, pattern_len, size);
+        passed = 0;
+    }
+    return passed;
+}
+
+static void do_validation_pattern(int repeat) {
+    uint8_t pattern[PATTERN_MAX_LEN];
+    for (int f = 0; f < NU_PATTERN_FILLS; f++) {
+        const pattern_fill_t *fill = &pattern_fill[f];
+        int passed = 1;
+        printf("%s:\n", fill->name);
+        /*
+         * Every destination misalignment with 1 to 8 elements, and for the
+         * pattern fills every size up to 8 patterns, which covers each
+         * combination of head and tail stores.
+         */
+        for (int j = 0; j < PATTERN_MAX_LEN; j++)
+            pattern[j] = 0x11 * (j + 1);
+        printf("Testing destination offsets 0 to 7 with 1 to 8 elements.\n");
+        fflush(stdout);
+        for (int dest = 0; dest < 8; dest++)
+            for (int size = 1; size <= 8 * fill->pattern_len; size++)
+                if (fill->is_pattern || size % fill->pattern_len == 0)
+                    passed &= validate_pattern_fill(fill, pattern, fill->pattern_len, dest,
+                        size);
+        for (int i = 0; i < 10 * repeat; i++)  {
+            int pattern_len = fill->pattern_len;
+            if (fill->fastarm_func == fastarm_fill_pattern)
+                pattern_len = 1 + rand() % PATTERN_MAX_LEN;
+            int size = floor(pow(2.0, (double)rand() * 20.0 / RAND_MAX));
+            if (!fill->is_pattern)
+                size -= size % pattern_len;
+            int dest = rand() % (1024 * 1024 * 16 + 1 - size);
+            for (int j = 0; j < pattern_len; j++)
+                pattern[j] = rand();
+            printf("Testing (destination offset = 0x%08X, pattern length = %d, size = %d).\n",
+                dest, pattern_len, size);
+            fflush(stdout);
+            passed &= validate_pattern_fill(fill, pattern, pattern_len, dest, size);
+        }
+        if (passed) {
+            printf("Passed.\n");
+        }
+    }
+}
+
+static void do_pattern_test(const pattern_fill_t *fill, const char *method,
+pattern_fill_func_type func, int size, int offset) {
+    uint8_t pattern[8] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0 };
+    uint8_t *dest = buffer_page + offset;
+    clear_data_cache();
+    double start_time = get_time();
+    double end_time;
+    int count = 0;
+    for (;;) {
+        func(dest, pattern, fill->pattern_len, size);
+        count++;
+        end_time = get_time();
+        if (end_time - start_time >= test_duration)
+            break;
+    }
+    double t = end_time - start_time;
+    printf("%s, %d bytes, destination offset %d (%s): %.2lf MB/s\n", fill->name, size,
+        offset, method, (double)size * count / (1024 * 1024) / t);
+}
+
+static void do_pattern_tests() {
+    for (int f = 0; f < NU_PATTERN_FILLS; f++) {
+        const pattern_fill_t *fill = &pattern_fill[f];
+        for (int i = 0; i < PATTERN_NU_SIZES; i++)
+            for (int offset = 0; offset < 2; offset++) {
+                int size = pattern_size[i];
+                if (!fill->is_pattern)
+                    size -= size % fill->pattern_len;
+                do_pattern_test(fill, "scalar", fill->scalar_func, size, offset);
+                if (fill->library_func != NULL && offset == 0)
+                    do_pattern_test(fill, fill->library_name, fill->library_func, size, offset);
+                do_pattern_test(fill, fill->name, fill->fastarm_func, size, offset);
+            }
+    }
+}
+
+/*
+ * Copies with locality hints (--hint). Each operation copies from a source
+ * and to a destination that move through 8 MB regions, so that both start
+ * out of the cache, and is followed by the access the hint describes:
+ * reading the destination (for example a received packet), or re-accessing
+ * an unrelated hot working set of 16 KB (neither side of the copy is
+ * reused). The time of the copy and the follow-up access together is
+ * reported for fastarm_memcpy_hint with each flag combination and for the
+ * memcpy variant.
+ */
+
+#define HINT_REGION_SIZE (8 * 1024 * 1024)
+#define HINT_WORKING_SET_SIZE (16 * 1024)
+#define HINT_NU_SIZES 3
+#define HINT_NU_FLAGS 8
+
+static const int hint_size[HINT_NU_SIZES] = { 4096, 64 * 1024, 1024 * 1024 };
+
+static const struct {
+    const char *name;
+    unsigned int flags;
+} hint_flags[HINT_NU_FLAGS] = {
+    { "default", 0 },
+    { "near", FASTARM_HINT_PRELOAD_NEAR },
+    { "far", FASTARM_HINT_PRELOAD_FAR },
+    { "none", FASTARM_HINT_PRELOAD_NONE },
+    { "default, dest read soon", FASTARM_HINT_DEST_READ_SOON },
+    { "near, dest read soon", FASTARM_HINT_PRELOAD_NEAR | FASTARM_HINT_DEST_READ_SOON },
+    { "far, dest read soon", FASTARM_HINT_PRELOAD_FAR | FASTARM_HINT_DEST_READ_SOON },
+    { "far, src no reuse", FASTARM_HINT_PRELOAD_FAR | FASTARM_HINT_SRC_NO_REUSE },
 };
 
-#define NU_MEMSET_TESTS 23
+static volatile uint32_t hint_sink;
+
+/* Read every word of the buffer. */
+static void __attribute__((noinline)) hint_read(const uint8_t *buffer, int size) {
+    const uint32_t *p = (const uint32_t *)buffer;
+    uint32_t sum = 0;
+    for (int i = 0; i < size / 4; i++)
+        sum += p[i];
+    hint_sink = sum;
+}
+
+/* Read one word per cache line of the buffer. */
+static void __attribute__((noinline)) hint_touch_lines(const uint8_t *buffer, int size) {
+    uint32_t sum = 0;
+    for (int i = 0; i < size; i += 32)
+        sum += *(const uint32_t *)(buffer + i);
+    hint_sink = sum;
+}
+
+/*
+ * Time copy + follow-up operations. flags is -1 for the memcpy variant.
+ * When read_dest is set the follow-up reads the destination, otherwise it
+ * re-accesses the working set.
+ */
+static void do_hint_test(int size, int read_dest, int flags, const char *name) {
+    uint8_t *src_region = buffer_page;
+    uint8_t *dest_region = buffer_page + HINT_REGION_SIZE;
+    uint8_t *working_set = buffer_page + 2 * HINT_REGION_SIZE;
+    clear_data_cache();
+    hint_touch_lines(working_set, HINT_WORKING_SET_SIZE);
+    double start_time = get_time();
+    double end_time;
+    int count = 0;
+    int offset = 0;
+    for (;;) {
+        if (flags < 0)
+            memcpy_func(dest_region + offset, src_region + offset, size);
+        else
+            fastarm_memcpy_hint(dest_region + offset, src_region + offset, size, flags);
+        if (read_dest)
+            hint_read(dest_region + offset, size);
+        else
+            hint_touch_lines(working_set, HINT_WORKING_SET_SIZE);
+        offset += size;
+        if (offset + size > HINT_REGION_SIZE)
+            offset = 0;
+        count++;
+        end_time = get_time();
+        if (end_time - start_time >= test_duration)
+            break;
+    }
+    printf("%d bytes, %s (%s): %.2lf us per copy and access\n", size,
+        read_dest ? "read destination" : "re-access working set", name,
+        (end_time - start_time) * 1000000.0 / count);
+}
+
+/*
+ * FASTARM_HINT_DEST_READ_SOON selects the variants with write preloads, which
+ * require the multiprocessing extensions.
+ */
+static int hint_flags_supported(unsigned int flags, int has_mp) {
+    return has_mp || (flags & FASTARM_HINT_DEST_READ_SOON) == 0;
+}
+
+static void do_hint_tests(const char *variant_name) {
+    int has_mp = cpu_has_mp_extensions();
+    for (int read_dest = 1; read_dest >= 0; read_dest--)
+        for (int i = 0; i < HINT_NU_SIZES; i++) {
+            do_hint_test(hint_size[i], read_dest, - 1, variant_name);
+            for (int j = 0; j < HINT_NU_FLAGS; j++)
+                if (hint_flags_supported(hint_flags[j].flags, has_mp))
+                    do_hint_test(hint_size[i], read_dest, hint_flags[j].flags,
+                        hint_flags[j].name);
+        }
+}
+
+static unsigned int validation_hint_flags;
+
+static void *hint_memcpy(void *dest, const void *src, size_t n) {
+    return fastarm_memcpy_hint(dest, src, n, validation_hint_flags);
+}
+
+/*
+ * Validate fastarm_memcpy_hint (--hint --validate) with every combination of
+ * flags, which covers each of its instantiations.
+ */
+static void do_validation_hint(int repeat) {
+    int has_mp = cpu_has_mp_extensions();
+    for (unsigned int flags = 0; flags <= (FASTARM_HINT_PRELOAD_MASK |
+    FASTARM_HINT_DEST_READ_SOON | FASTARM_HINT_SRC_NO_REUSE); flags++) {
+        if (!hint_flags_supported(flags, has_mp)) {
+            printf("Skipping flags 0x%X: no multiprocessing extensions.\n", flags);
+            continue;
+        }
+        printf("fastarm_memcpy_hint, flags 0x%X:\n", flags);
+        validation_hint_flags = flags;
+        memcpy_func = hint_memcpy;
+        do_validation(repeat);
+    }
+}
+
+/*
+ * Size x misalignment sweep (--sweep). Each size from 0 to the limit (in
+ * steps of sweep_size_step) is measured for each combination of source and
+ * destination misalignment from 0 to 63 (in steps of sweep_align_step), with
+ * the source and destination resident in the cache. The time per call is the
+ * minimum over a few rounds of back-to-back calls, minus the time of an empty
+ * function. The results are written as CSV and optionally as a PGM heatmap
+ * per variant, in which each row is a size, each column a misalignment
+ * combination (source major) and the brightness the throughput relative to
+ * the highest throughput of the variant, so that cliffs at the thresholds of
+ * the fast paths show up as dark bands.
+ */
+
+#define SWEEP_CALLS 64
+#define SWEEP_ROUNDS 5
+#define SWEEP_MAX_SIZE (1024 * 1024)
+
+int sweep_limit;
+int sweep_size_step = 1;
+int sweep_align_step = 8;
+const char *sweep_output;
+
+static double __attribute__((noinline)) time_sweep_point(void *func, int is_memset,
+uint8_t *dest, const uint8_t *src, int size) {
+    int64_t best = INT64_MAX;
+    for (int r = 0; r < SWEEP_ROUNDS; r++) {
+        int64_t start_time = get_time_ns();
+        if (is_memset)
+            for (int k = 0; k < SWEEP_CALLS; k++)
+                ((memset_func_type)func)(dest, k, size);
+        else
+            for (int k = 0; k < SWEEP_CALLS; k++)
+                ((memcpy_func_type)func)(dest, src, size);
+        int64_t t = get_time_ns() - start_time;
+        if (t < best)
+            best = t;
+    }
+    return (double)best / SWEEP_CALLS;
+}
+
+static void do_sweep(FILE *csv, int variant, int is_memset) {
+    void *func = is_memset ? (void *)memset_variant[variant] : (void *)memcpy_variant[variant];
+    const char *name = is_memset ? memset_variant_name[variant] : memcpy_variant_name[variant];
+    int nu_sizes = sweep_limit / sweep_size_step + 1;
+    int nu_offsets = (64 + sweep_align_step - 1) / sweep_align_step;
+    int nu_columns = is_memset ? nu_offsets : nu_offsets * nu_offsets;
+    double *throughput = malloc(sizeof(double) * nu_sizes * nu_columns);
+    double max_throughput = 0;
+    uint8_t *src = buffer_page;
+    uint8_t *dest = buffer_page + 2 * SWEEP_MAX_SIZE;
+    void *empty = is_memset ? (void *)empty_memset : (void *)empty_memcpy;
+    double overhead = time_sweep_point(empty, is_memset, dest, src, 0);
+    printf("%s:\n", name);
+    for (int s = 0; s < nu_sizes; s++) {
+        int size = s * sweep_size_step;
+        for (int c = 0; c < nu_columns; c++) {
+            int src_offset = is_memset ? 0 : (c / nu_offsets) * sweep_align_step;
+            int dest_offset = (c % nu_offsets) * sweep_align_step;
+            /* Bring the buffers into the cache. */
+            memset(dest + dest_offset, 0, size);
+            double ns = time_sweep_point(func, is_memset, dest + dest_offset, src + src_offset,
+                size) - overhead;
+            if (ns < 0.1)
+                ns = 0.1;
+            double mb_per_s = size / ns * 1000000000.0 / (1024 * 1024);
+            throughput[s * nu_columns + c] = mb_per_s;
+            if (mb_per_s > max_throughput)
+                max_throughput = mb_per_s;
+            fprintf(csv, "\"%s\",%d,%d,%d,%.2lf,%.2lf\n", name, size, src_offset, dest_offset,
+                ns, mb_per_s);
+        }
+    }
+    if (sweep_output != NULL) {
+        char *filename = malloc(strlen(sweep_output) + 16);
+        sprintf(filename, "%s_%s%d.pgm", sweep_output, is_memset ? "memset" : "memcpy", variant);
+        FILE *f = fopen(filename, "wb");
+        if (f == NULL)
+            printf("Unable to write %s.\n", filename);
+        else {
+            fprintf(f, "P5\n# %s\n%d %d\n255\n", name, nu_columns, nu_sizes);
+            for (int i = 0; i < nu_sizes * nu_columns; i++)
+                fputc(max_throughput > 0 ? (int)(throughput[i] * 255.0 / max_throughput) : 0, f);
+            fclose(f);
+            printf("Heatmap written to %s (%d misalignment combinations x %d sizes).\n",
+                filename, nu_columns, nu_sizes);
+        }
+        free(filename);
+    }
+    free(throughput);
+}
+
+static void do_sweeps(int memcpy_specified, int memset_specified) {
+    FILE *csv = stdout;
+    if (sweep_output != NULL) {
+        char *filename = malloc(strlen(sweep_output) + 5);
+        sprintf(filename, "%s.csv", sweep_output);
+        csv = fopen(filename, "w");
+        if (csv == NULL) {
+            printf("Unable to write %s.\n", filename);
+            return;
+        }
+        printf("Writing %s.\n", filename);
+        free(filename);
+    }
+    fprintf(csv, "variant,size,src_misalignment,dst_misalignment,ns_per_call,mb_per_s\n");
+    for (int j = 0; j < nu_memcpy_variants; j++)
+        if (memcpy_specified && memcpy_mask[j] &&
+        get_required_alignment((const void *)memcpy_variant[j]) == 0)
+            do_sweep(csv, j, 0);
+    for (int j = 0; j < nu_memset_variants; j++)
+        if (memset_specified && memset_mask[j] &&
+        get_required_alignment((const void *)memset_variant[j]) == 0)
+            do_sweep(csv, j, 1);
+    if (csv != stdout)
+        fclose(csv);
+}
+
+/*
+ * Source/destination distance and cache-set aliasing (--aliasing). The source
+ * is copied to a destination at a distance that is a multiple of the line
+ * size, the page size, the way size of the L1 and L2 caches (cache size
+ * divided by associativity, so that source and destination map to the same
+ * sets) or 1 MB, plus a small positive or negative offset, for several copy
+ * sizes with the buffers in the cache. Each copy is checked for correctness.
+ * A variant breaks down under aliasing when the throughput at a distance is
+ * below ALIASING_BREAKDOWN_RATIO times the median throughput of that size.
+ */
+
+#define ALIASING_NU_SIZES 4
+#define ALIASING_NU_OFFSETS 8
+#define ALIASING_MAX_UNITS 5
+#define ALIASING_BREAKDOWN_RATIO 0.75
+
+static const int aliasing_size[ALIASING_NU_SIZES] = { 256, 4096, 32768, 256 * 1024 };
+static const int aliasing_offset[ALIASING_NU_OFFSETS] = { - 64, - 32, - 16, 0, 16, 32, 64, 2048 };
+
+typedef struct {
+    const char *name;
+    int unit;
+} aliasing_unit_t;
+
+static aliasing_unit_t aliasing_unit[ALIASING_MAX_UNITS];
+static int nu_aliasing_units;
+
+/* Return the way size of the cache at the given level, or 0 if unknown. */
+static int cache_way_size(int level) {
+    for (int i = 0; i < 4; i++) {
+        char path[128], type[32];
+        int l, size, ways;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!read_sysfs_int(path, &l))
+            break;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        read_sysfs_value(path, type, sizeof(type));
+        if (l != level || strcmp(type, "Instruction") == 0)
+            continue;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if (!read_sysfs_int(path, &size))
+            return 0;
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/ways_of_associativity", i);
+        if (!read_sysfs_int(path, &ways) || ways <= 0)
+            return 0;
+        return size * 1024 / ways;
+    }
+    return 0;
+}
+
+static void add_aliasing_unit(const char *name, int unit) {
+    for (int i = 0; i < nu_aliasing_units; i++)
+        if (aliasing_unit[i].unit == unit)
+            return;
+    aliasing_unit[nu_aliasing_units].name = name;
+    aliasing_unit[nu_aliasing_units].unit = unit;
+    nu_aliasing_units++;
+}
+
+static void init_aliasing_units() {
+    int l1_way = cache_way_size(1);
+    int l2_way = cache_way_size(2);
+    nu_aliasing_units = 0;
+    add_aliasing_unit("line", 64);
+    add_aliasing_unit("page", 4096);
+    /* The Cortex-A8/A9 L1 data caches have 4 ways of 4 or 8 KB. */
+    add_aliasing_unit("L1 way", l1_way > 0 ? l1_way : 8192);
+    /* A 512 KB 8-way L2 cache has ways of 64 KB. */
+    add_aliasing_unit("L2 way", l2_way > 0 ? l2_way : 65536);
+    add_aliasing_unit("1 MB", 1024 * 1024);
+}
+
+/*
+ * Return the smallest distance that is a multiple of unit, plus offset, at
+ * which source and destination of the given size do not overlap.
+ */
+static int aliasing_distance(int size, int unit, int offset) {
+    int distance = (size + 64 + unit - 1) / unit * unit;
+    return distance + offset;
+}
+
+/*
+ * Test the aliasing behaviour of a memcpy variant. Returns 1 when the variant
+ * breaks down under aliasing or is incorrect at some distance.
+ */
+static int do_aliasing_test(int variant) {
+    memcpy_func_type func = memcpy_variant[variant];
+    uint8_t *src = buffer_page;
+    double worst_ratio = 1.0;
+    int worst_size = 0, worst_distance = 0;
+    int correct = 1;
+    printf("%s:\n", memcpy_variant_name[variant]);
+    for (int s = 0; s < ALIASING_NU_SIZES; s++) {
+        int size = aliasing_size[s];
+        double t[ALIASING_MAX_UNITS * ALIASING_NU_OFFSETS];
+        double sorted[ALIASING_MAX_UNITS * ALIASING_NU_OFFSETS];
+        int n = 0;
+        for (int i = 0; i < size; i++)
+            src[i] = i * 7 + s;
+        for (int u = 0; u < nu_aliasing_units; u++) {
+            printf("%d bytes, %s multiple:", size, aliasing_unit[u].name);
+            for (int k = 0; k < ALIASING_NU_OFFSETS; k++) {
+                int distance = aliasing_distance(size, aliasing_unit[u].unit, aliasing_offset[k]);
+                uint8_t *dest = src + distance;
+                memset(dest, 0, size);
+                t[n] = time_sweep_point((void *)func, 0, dest, src, size);
+                if (memcmp(dest, src, size) != 0) {
+                    printf(" [incorrect at distance %d]", distance);
+                    correct = 0;
+                }
+                printf(" %+d: %.0lf", aliasing_offset[k], size / t[n] * 1.0e9 / (1024 * 1024));
+                sorted[n] = t[n];
+                n++;
+            }
+            printf(" MB/s\n");
+        }
+        /* The median time; the throughput ratio is the inverse of the time ratio. */
+        for (int i = 1; i < n; i++)
+            for (int j = i; j > 0 && sorted[j] < sorted[j - 1]; j--) {
+                double x = sorted[j];
+                sorted[j] = sorted[j - 1];
+                sorted[j - 1] = x;
+            }
+        double median = sorted[n / 2];
+        for (int i = 0; i < n; i++)
+            if (median / t[i] < worst_ratio) {
+                worst_ratio = median / t[i];
+                worst_size = size;
+                worst_distance = aliasing_distance(size,
+                    aliasing_unit[i / ALIASING_NU_OFFSETS].unit,
+                    aliasing_offset[i % ALIASING_NU_OFFSETS]);
+            }
+    }
+    if (!correct)
+        printf("Validation failed at aliasing distances.\n");
+    if (worst_ratio < ALIASING_BREAKDOWN_RATIO) {
+        printf("Breaks down under aliasing: %.0lf%% of the median throughput for %d bytes at "
+            "distance %d.\n", worst_ratio * 100.0, worst_size, worst_distance);
+        return 1;
+    }
+    printf("No breakdown under aliasing (worst %.0lf%% of the median throughput).\n",
+        worst_ratio * 100.0);
+    return !correct;
+}
+
+static void do_aliasing_tests() {
+    int failed[MAX_MEMCPY_VARIANTS];
+    int nu_failed = 0;
+    init_aliasing_units();
+    printf("Distance units:");
+    for (int u = 0; u < nu_aliasing_units; u++)
+        printf(" %s %d", aliasing_unit[u].name, aliasing_unit[u].unit);
+    printf(" bytes\n");
+    for (int j = 0; j < nu_memcpy_variants; j++)
+        if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0)
+            if (do_aliasing_test(j))
+                failed[nu_failed++] = j;
+    printf("Aliasing report: ");
+    if (nu_failed == 0)
+        printf("no variant breaks down under aliasing.\n");
+    else {
+        printf("%d variant(s) break down or fail under aliasing:\n", nu_failed);
+        for (int i = 0; i < nu_failed; i++)
+            printf("    %s\n", memcpy_variant_name[failed[i]]);
+    }
+}
+
+/*
+ * Cache pollution measurement. A victim working set, standing for the hot
+ * data of the caller, is primed in the cache, a single copy is performed and
+ * the time to access the victim set again is compared with the time it takes
+ * without the intervening copy.
+ */
+
+#define POLLUTION_ROUNDS 256
+
+int victim_size = 16 * 1024;
+
+/* Follow a pointer chain of n nodes once; returns the time taken. */
+static double chase_once(void *start, int n) {
+    void **p = start;
+    double start_time = get_time();
+    for (int i = 0; i < n; i++)
+        p = *p;
+    double t = get_time() - start_time;
+    probe_sink = p;
+    return t;
+}
+
+static void do_pollution_test(const char *name, void (*test_func)(int), int bytes,
+uint8_t *victim, uint8_t **addr) {
+    double bandwidth = (double)bytes / (1024 * 1024) / time_test(test_func, bytes);
+    void *start = create_random_chain(victim, victim_size, 32, addr);
+    int n = victim_size / 32;
+    double t_base = 0, t_after = 0;
+    for (int round = 0; round < POLLUTION_ROUNDS; round++) {
+        chase_once(start, n);
+        t_base += chase_once(start, n);
+        chase_once(start, n);
+        test_func(round);
+        t_after += chase_once(start, n);
+    }
+    t_base /= POLLUTION_ROUNDS;
+    t_after /= POLLUTION_ROUNDS;
+    printf("%s: %.2lf MB/s, victim re-access %.2lf us -> %.2lf us (%+.1lf%%)\n", name,
+        bandwidth, t_base * 1000000.0, t_after * 1000000.0,
+        (t_after - t_base) * 100.0 / t_base);
+}
+
+static void do_pollution_tests() {
+    uint8_t *victim;
+    if (posix_memalign((void **)&victim, 4096, victim_size) != 0)
+        return;
+    uint8_t **addr = malloc(sizeof(uint8_t *) * (victim_size / 32));
+    for (int t = 0; t < NU_TESTS; t++)
+        if (strstr(test[t].name, "page aligned") != NULL)
+            do_pollution_test(test[t].name, test[t].test_func, test[t].bytes, victim, addr);
+    free(addr);
+    free(victim);
+}
 
-static test_t memset_test[NU_MEMSET_TESTS] = {
-    { "Mixed powers of 2 from 4 to 4096 (power law), word aligned", test_memset_mixed_powers_of_two_word_aligned, 2048 },
-    { "Mixed multiples of 4 from 4 to 1024 (power law), word aligned", test_memset_mixed_power_law_word_aligned, 512 },
-    { "Mixed from 1 to 1023 (power law), unaligned", test_memset_mixed_power_law_unaligned, 512 },
-    { "1024 bytes page aligned", test_memset_page_aligned_1024, 1024 },
-    { "4096 bytes page aligned", test_memset_page_aligned_4096, 4096 },
-    { "4 bytes word aligned", test_memset_aligned_4, 4 },
-    { "8 bytes word aligned", test_memset_aligned_8, 8 },
-    { "16 bytes word aligned", test_memset_aligned_16, 16 },
-    { "28 bytes word aligned", test_memset_aligned_28, 28 },
-    { "32 bytes word aligned", test_memset_aligned_32, 32 },
-    { "64 bytes word aligned", test_memset_aligned_64, 64 },
-    { "64 bytes various alignments word aligned (multi-test)", test_memset_various_aligned_64, 64 },
-    { "80 bytes word aligned", test_memset_aligned_80, 80 },
-    { "92 bytes word aligned", test_memset_aligned_92, 92 },
-    { "128 bytes word aligned", test_memset_aligned_128, 128 },
-    { "256 bytes word aligned", test_memset_aligned_256, 256 },
-    { "3 bytes randomly aligned", test_memset_unaligned_random_3, 3 },
-    { "8 bytes randomly aligned", test_memset_unaligned_random_8, 8 },
-    { "17 bytes randomly aligned", test_memset_unaligned_random_17, 17 },
-    { "28 bytes randomly aligned", test_memset_unaligned_random_28, 28 },
-    { "64 bytes randomly aligned", test_memset_unaligned_random_64, 64 },
-    { "137 bytes randomly aligned", test_memset_unaligned_random_137, 137 },
-    { "1023 bytes randomly aligned", test_memset_unaligned_random_1023, 1023 },
-};
+/*
+ * Load a memcpy or memset implementation from a shared object. spec has the
+ * form library:symbol[,name]; symbols containing "memset" are added as memset
+ * variants, others as memcpy variants. Returns 0 on failure. The libraries
+ * and names are released at exit.
+ */
+
+static void *loaded_handle[MAX_LOADED_VARIANTS];
+static char *loaded_name[MAX_LOADED_VARIANTS];
+static int nu_loaded_variants;
+
+static void unload_variants() {
+    for (int i = 0; i < nu_loaded_variants; i++) {
+        free(loaded_name[i]);
+        dlclose(loaded_handle[i]);
+    }
+    nu_loaded_variants = 0;
+}
+
+static int load_variant(const char *spec) {
+    if (nu_loaded_variants == MAX_LOADED_VARIANTS) {
+        printf("Too many loaded variants.\n");
+        return 0;
+    }
+    char *s = strdup(spec);
+    char *name = strchr(s, ',');
+    if (name != NULL)
+        *name++ = '\0';
+    char *symbol = strrchr(s, ':');
+    if (symbol == NULL || symbol == s || symbol[1] == '\0') {
+        printf("Invalid --load specification %s (expected library:symbol[,name]).\n", spec);
+        free(s);
+        return 0;
+    }
+    *symbol++ = '\0';
+    void *handle = dlopen(s, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        printf("Unable to load %s: %s.\n", s, dlerror());
+        free(s);
+        return 0;
+    }
+    void *func = dlsym(handle, symbol);
+    if (func == NULL) {
+        printf("Symbol %s not found in %s.\n", symbol, s);
+        dlclose(handle);
+        free(s);
+        return 0;
+    }
+    if (name != NULL)
+        name = strdup(name);
+    else {
+        name = malloc(strlen(symbol) + strlen(s) + 7);
+        sprintf(name, "%s from %s", symbol, s);
+    }
+    int is_memset = strstr(symbol, "memset") != NULL;
+    free(s);
+    if (is_memset) {
+        if (nu_memset_variants == MAX_MEMSET_VARIANTS) {
+            printf("Too many loaded memset variants.\n");
+            dlclose(handle);
+            free(name);
+            return 0;
+        }
+        memset_variant_name[nu_memset_variants] = name;
+        memset_variant[nu_memset_variants] = (memset_func_type)func;
+        nu_memset_variants++;
+    }
+    else {
+        if (nu_memcpy_variants == MAX_MEMCPY_VARIANTS) {
+            printf("Too many loaded memcpy variants.\n");
+            dlclose(handle);
+            free(name);
+            return 0;
+        }
+        memcpy_variant_name[nu_memcpy_variants] = name;
+        memcpy_variant[nu_memcpy_variants] = (memcpy_func_type)func;
+        nu_memcpy_variants++;
+    }
+    if (nu_loaded_variants == 0)
+        atexit(unload_variants);
+    loaded_handle[nu_loaded_variants] = handle;
+    loaded_name[nu_loaded_variants] = name;
+    nu_loaded_variants++;
+    return 1;
+}
+
+/*
+ * Add the other instruction set encoding of each built-in variant that has
+ * one, found by appending the mode to the symbol of the variant. The names of
+ * both encodings are marked with their mode.
+ */
+static void add_mode_twins(int is_memset) {
+    int nu_builtin_variants = is_memset ? NU_BUILTIN_MEMSET_VARIANTS : NU_BUILTIN_MEMCPY_VARIANTS;
+    int *nu_variants = is_memset ? &nu_memset_variants : &nu_memcpy_variants;
+    const char **variant_name = is_memset ? memset_variant_name : memcpy_variant_name;
+    for (int i = 0; i < nu_builtin_variants; i++) {
+        Dl_info info;
+        const void *func = is_memset ? (const void *)memset_variant[i] :
+            (const void *)memcpy_variant[i];
+        if (dladdr(func, &info) == 0 || info.dli_sname == NULL)
+            continue;
+        static const char *suffix[2] = { "_arm", "_thumb" };
+        static const char *mode_name[2] = { "ARM", "Thumb2" };
+        for (int m = 0; m < 2; m++) {
+            char symbol[256];
+            snprintf(symbol, sizeof(symbol), "%s%s", info.dli_sname, suffix[m]);
+            void *twin = dlsym(RTLD_DEFAULT, symbol);
+            if (twin == NULL)
+                continue;
+            /* ARMv6 cores do not implement Thumb2. */
+            if (m == 1 && cpu_architecture() < 7)
+                break;
+            char *name = malloc(strlen(variant_name[i]) + 10);
+            sprintf(name, "%s (%s)", variant_name[i], mode_name[m]);
+            variant_name[*nu_variants] = name;
+            name = malloc(strlen(variant_name[i]) + 10);
+            sprintf(name, "%s (%s)", variant_name[i], mode_name[1 - m]);
+            variant_name[i] = name;
+            if (is_memset)
+                memset_variant[*nu_variants] = (memset_func_type)twin;
+            else
+                memcpy_variant[*nu_variants] = (memcpy_func_type)twin;
+            mode_twin[nu_mode_twins].is_memset = is_memset;
+            mode_twin[nu_mode_twins].variant = *nu_variants;
+            mode_twin[nu_mode_twins].base = i;
+            nu_mode_twins++;
+            (*nu_variants)++;
+            break;
+        }
+    }
+}
 
 static void usage() {
             printf("Commands:\n"
-                "--list          List test numbers and memcpy variants.\n"
+                "--list          List test numbers and memcpy variants. Use after --load to include loaded\n"
+                "                variants.\n"
                 "--test <number> Perform test <number> only, 5 times for each memcpy variant.\n"
                 "--all           Perform each test 5 times for each memcpy variant.\n"
+                "--tests <file>  Perform the tests described in <file> (see the README) instead of the\n"
+                "                built-in tests, for the selected memcpy or memset variants.\n"
+                "--async         Measure the overlap of asynchronous copies with computation, using the\n"
+                "                selected memcpy variants (default NEON with line size 32) in the copy worker.\n"
+                "--batch         Compare separate memcpy calls with the batched and gather copy API for many\n"
+                "                small heterogeneous copies, using the selected memcpy variants.\n"
+                "--scenarios     Run scenario tests modeled on real callers (vector growth, packet copies,\n"
+                "                frame copies, small struct copies and damage rectangle blits) for each\n"
+                "                memcpy variant, reporting the time per operation.\n"
+                "--diff          Compare fastarm_memcpy_diff with a full copy by the selected memcpy\n"
+                "                variants (default NEON with line size 32) for a state block and a frame\n"
+                "                of which 0%%, 1%%, 10%% or 100%% of the lines change between copies.\n"
+                "--pattern       Compare fastarm_memset16/32/64 and the pattern fills with scalar store\n"
+                "                loops (and wmemset) for several sizes. With --validate, validate them instead.\n"
+                "--hint          Measure fastarm_memcpy_hint with each combination of locality hints and the\n"
+                "                selected memcpy variants (default NEON with line size 32), timing each copy\n"
+                "                together with reading the destination or re-accessing a hot working set.\n"
+                "                With --validate, validate fastarm_memcpy_hint with each combination instead.\n"
+                "--filecopy      Copy a 64 MB file on tmpfs (/dev/shm) and on local disk (the current\n"
+                "                directory) to a buffer and to another file with read()/write() loops and\n"
+                "                with fastarm_copy_file_to_buffer/fastarm_copy_file_range, using the selected\n"
+                "                memcpy variants (default NEON with line size 32).\n"
+                "--aliasing      Copy with the destination at distances from the source that are multiples\n"
+                "                of the line, page, L1/L2 way size and 1 MB plus small offsets for several\n"
+                "                sizes, validating each copy and reporting which selected memcpy variants\n"
+                "                break down under cache set aliasing.\n"
+                "--sweep <n>     Measure each size from 0 to <n> bytes for each combination of source and\n"
+                "                destination misalignment from 0 to 63 for the selected memcpy or memset\n"
+                "                variants, with the buffers in the cache. The results are printed as CSV.\n"
+                "--pollution     For each page aligned test, report the copy bandwidth together with the\n"
+                "                slowdown of re-accessing a victim working set that was primed in the cache\n"
+                "                before a single copy, for the selected memcpy variants.\n"
+                "--probe         Measure cache sizes, latencies, line fill size, hardware prefetcher reach\n"
+                "                and the best software preload distance, and recommend settings.\n"
                 "--help          Show this message.\n"
                 "Options:\n"
                 "--duration <n>  Sets the duration of each individual test. Default is 2 seconds.\n"
@@ -960,8 +4444,59 @@ static void usage() {
                 "--memcpy <list> Instead of testing all memcpy variants, test only the memcpy variants\n"
                 "                in <list>. <list> is a string of characters from a to h or higher, corresponding\n"
                 "                to each memcpy variant (for example, abcdef selects the first six variants).\n"
+                "                Variants without a character in --list can be selected with [n].\n"
+                "--sweep-step <n> Size step of --sweep. Default is 1.\n"
+                "--sweep-align-step <n> Misalignment step of --sweep. Default is 8.\n"
+                "--sweep-output <prefix> Write the --sweep results to <prefix>.csv and a PGM heatmap per\n"
+                "                variant to <prefix>_memcpy<n>.pgm or <prefix>_memset<n>.pgm.\n"
+                "--victim-size <n> Size in KB of the victim working set of --pollution (multiple of 4).\n"
+                "                Default is 16.\n"
+                "--noise <n>     Run <n> background threads stressing memory on other cores and measure\n"
+                "                each test both without and with the background load (--test, --all and\n"
+                "                --scenarios).\n"
+                "--noise-pattern <p> Access pattern of the background threads: read, write, chase (random\n"
+                "                pointer chase) or mixed. Default is read.\n"
+                "--load <library>:<symbol>[,<name>] Load a memcpy implementation (or memset, when the\n"
+                "                symbol contains \"memset\") from a shared object and test it alongside the\n"
+                "                built-in variants. Can be given multiple times; loaded variants are always\n"
+                "                selected.\n"
+                "--both-modes    Add the ARM encoding of each assembler variant when the benchmark is built\n"
+                "                in Thumb2 mode (or the Thumb2 encoding when built in ARM mode). The other\n"
+                "                encoding of a variant is selected along with the variant. Use before --list\n"
+                "                and --memcpy/--memset [n] to include them.\n"
                 "--validate      Validate for correctness instead of measuring performance. The --repeat option\n"
                 "                can be used to influence the number of validation tests performed (default 5).\n"
+                "--validate-exports <library> Validate the memcpy and memset entry points exported by a\n"
+                "                replacement library such as libfastarm.so (memcpy, memset, the __aeabi_*\n"
+                "                run-time ABI functions, __memcpy_chk, __memset_chk, mempcpy and bzero) for\n"
+                "                all sizes up to 256 bytes and all allowed misalignments.\n"
+                "--cold-icache   Evict the variant's code from the instruction cache before each call by\n"
+                "                running through 128 KB of code, to rank variants under the I-cache\n"
+                "                pressure of large programs. Only the calls themselves are timed.\n"
+                "--calibrated    Record the calls of each test and replay them from a cache-resident array\n"
+                "                in a tight loop calling the variant directly. The overhead of the loop,\n"
+                "                measured with an empty function, is subtracted and reported, as well as\n"
+                "                the bytes per cycle (--test, --all and --tests).\n"
+                "--roofline      First measure the peak read, write and copy bandwidth of the L1 and L2\n"
+                "                caches and DRAM, then report each result as a percentage of the matching\n"
+                "                peak (--test, --all and --tests).\n"
+                "--flush-size <n> Size in MB of the memory region read and written to flush the data cache\n"
+                "                before each test. Default is 32.\n"
+                "--interleave    Run the variants in a randomized round-robin order for each repeat instead\n"
+                "                of all repeats of one variant in a row, report the frequency and temperature\n"
+                "                with each result and rank the variants. Requires a suitable cpufreq governor\n"
+                "                (ondemand is refused unless --force is given).\n"
+                "--cpu <n>       Pin the benchmark to core <n>.\n"
+                "--force         Measure even when the cpufreq governor is unsuitable.\n"
+                "--save-baseline <file> Save the result distribution of each test and variant to <file>.\n"
+                "--compare-baseline <file> Compare the results with a baseline saved with --save-baseline\n"
+                "                using a one-sided Mann-Whitney U test. The exit status is 2 when a regression\n"
+                "                is detected.\n"
+                "--threshold <n> Minimum drop in median bandwidth in percent reported as a regression.\n"
+                "                Default is 2.\n"
+                "--confidence <n> Required confidence in percent that a slowdown is real. Default is 95.\n"
+                "--async-cpu <n> Pin the asynchronous copy worker to core <n> (-1 for no pinning). Default is\n"
+                "                core 1 on multi-core systems.\n"
                 );
 }
 
@@ -970,13 +4505,61 @@ static int char_to_memcpy_variant(char c) {
         return c - 'a';
     if (c >= 'A' && c <= 'Z')
         return c - 'A' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
     return - 1;
 }
 
 static char memcpy_variant_to_char(int i) {
     if (i < 26)
         return 'a' + i;
-    return 'A' + i - 26;
+    if (i < 52)
+        return 'A' + i - 26;
+    return '0' + i - 52;
+}
+
+/*
+ * Select the variants in a list of variant characters. Variants beyond the
+ * range of single characters can be selected with [n], where n is the
+ * variant index shown by --list.
+ */
+static void select_variants(const char *list, int *mask, int nu_variants) {
+    for (int i = 0; i < nu_variants; i++)
+        mask[i] = 0;
+    for (const char *p = list; *p != '\0'; p++) {
+        int v;
+        if (*p == '[') {
+            v = atoi(p + 1);
+            while (*p != '\0' && *p != ']')
+                p++;
+            if (*p == '\0')
+                break;
+        }
+        else
+            v = char_to_memcpy_variant(*p);
+        if (v >= 0 && v < nu_variants)
+            mask[v] = 1;
+    }
+}
+
+static void list_variants(int is_memset) {
+    int nu_variants = is_memset ? nu_memset_variants : nu_memcpy_variants;
+    int nu_builtin_variants = is_memset ? NU_BUILTIN_MEMSET_VARIANTS : NU_BUILTIN_MEMCPY_VARIANTS;
+    const char * const *variant_name = is_memset ? memset_variant_name : memcpy_variant_name;
+    for (int i = 0; i < nu_variants; i++) {
+        /* Variants loaded with --load are always selected and have no index. */
+        if (i >= nu_builtin_variants && !is_mode_twin(is_memset, i))
+            printf("  +    %s", variant_name[i]);
+        else if (i < 62)
+            printf("  %c    %s", memcpy_variant_to_char(i), variant_name[i]);
+        else
+            printf(" [%d] %s", i, variant_name[i]);
+        int code_size = get_code_size(is_memset ? (const void *)memset_variant[i] :
+            (const void *)memcpy_variant[i]);
+        if (code_size > 0)
+            printf(" (%d bytes of code)", code_size);
+        printf("\n");
+    }
 }
 
 int main(int argc, char *argv[]) {
@@ -987,13 +4570,32 @@ int main(int argc, char *argv[]) {
     int argi = 1;
     int command_test = - 1;
     int command_all = 0;
+    int command_async = 0;
+    int command_batch = 0;
+    int command_probe = 0;
+    int command_scenarios = 0;
+    int command_pollution = 0;
+    int command_diff = 0;
+    int command_pattern = 0;
+    int command_hint = 0;
+    int command_aliasing = 0;
+    int command_filecopy = 0;
+    int command_tests = 0;
+    int command_sweep = 0;
+    int force = 0;
+    const char *save_baseline = NULL;
+    const char *compare_baseline = NULL;
+    double regression_threshold = 2.0;
+    double regression_significance = 0.05;
+    int async_cpu = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 1 : - 1;
     int repeat = 5;
     int validate = 0;
+    const char *validate_exports = NULL;
     int memcpy_specified = 0;
     int memset_specified = 0;
-    for (int i = 0; i < NU_MEMCPY_VARIANTS; i++)
+    for (int i = 0; i < nu_memcpy_variants; i++)
         memcpy_mask[i] = 0;
-    for (int i = 0; i < NU_MEMSET_VARIANTS; i++)
+    for (int i = 0; i < nu_memset_variants; i++)
         memset_mask[i] = 0;
     for (;;) {
         if (argi >= argc)
@@ -1019,6 +4621,219 @@ int main(int argc, char *argv[]) {
             argi++;
             continue;
         }
+        if (strcasecmp(argv[argi], "--async") == 0) {
+            command_async = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--batch") == 0) {
+            command_batch = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--tests") == 0) {
+            if (!load_custom_tests(argv[argi + 1]))
+                return 1;
+            command_tests = 1;
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--sweep") == 0) {
+            sweep_limit = atoi(argv[argi + 1]);
+            if (sweep_limit < 1 || sweep_limit > SWEEP_MAX_SIZE) {
+                printf("Sweep size limit out of range.\n");
+                return 1;
+            }
+            command_sweep = 1;
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--sweep-step") == 0) {
+            sweep_size_step = atoi(argv[argi + 1]);
+            if (sweep_size_step < 1) {
+                printf("Sweep size step out of range.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--sweep-align-step") == 0) {
+            sweep_align_step = atoi(argv[argi + 1]);
+            if (sweep_align_step < 1 || sweep_align_step > 64) {
+                printf("Sweep alignment step out of range.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--sweep-output") == 0) {
+            sweep_output = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--diff") == 0) {
+            command_diff = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--pattern") == 0) {
+            command_pattern = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--hint") == 0) {
+            command_hint = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--filecopy") == 0) {
+            command_filecopy = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--aliasing") == 0) {
+            command_aliasing = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--pollution") == 0) {
+            command_pollution = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--noise") == 0) {
+            nu_noise_threads = atoi(argv[argi + 1]);
+            if (nu_noise_threads < 0 || nu_noise_threads > MAX_NOISE_THREADS) {
+                printf("Number of noise threads out of range.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--noise-pattern") == 0) {
+            noise_pattern = - 1;
+            for (int i = 0; i < 4; i++)
+                if (strcasecmp(argv[argi + 1], noise_pattern_name[i]) == 0)
+                    noise_pattern = i;
+            if (noise_pattern < 0) {
+                printf("Unknown noise pattern.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--victim-size") == 0) {
+            int n = atoi(argv[argi + 1]);
+            if (n < 4 || n > 16384 || (n & 3) != 0) {
+                printf("Victim size out of range.\n");
+                return 1;
+            }
+            victim_size = n * 1024;
+            argi += 2;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--scenarios") == 0) {
+            command_scenarios = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--probe") == 0) {
+            command_probe = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--interleave") == 0) {
+            interleave = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--force") == 0) {
+            force = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--cpu") == 0) {
+            benchmark_cpu = atoi(argv[argi + 1]);
+            if (benchmark_cpu < 0 || benchmark_cpu >= sysconf(_SC_NPROCESSORS_CONF)) {
+                printf("Core number out of range.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--save-baseline") == 0) {
+            save_baseline = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--compare-baseline") == 0) {
+            compare_baseline = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--threshold") == 0) {
+            regression_threshold = atof(argv[argi + 1]);
+            if (regression_threshold < 0 || regression_threshold >= 100.0) {
+                printf("Regression threshold out of range.\n");
+                return 1;
+            }
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--confidence") == 0) {
+            double confidence = atof(argv[argi + 1]);
+            if (confidence < 50.0 || confidence >= 100.0) {
+                printf("Confidence level out of range.\n");
+                return 1;
+            }
+            regression_significance = 1.0 - confidence / 100.0;
+            argi += 2;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--calibrated") == 0) {
+            calibrated = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--roofline") == 0) {
+            roofline = 1;
+            argi++;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--cold-icache") == 0) {
+            cold_icache = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--flush-size") == 0) {
+            int n = atoi(argv[argi + 1]);
+            if (n < 1 || n > 32) {
+                printf("Cache flush size out of range.\n");
+                return 1;
+            }
+            cache_flush_size = n * 1024 * 1024;
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--async-cpu") == 0) {
+            async_cpu = atoi(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--load") == 0) {
+            if (!load_variant(argv[argi + 1]))
+                return 1;
+            argi += 2;
+            continue;
+        }
+        if (strcasecmp(argv[argi], "--both-modes") == 0) {
+            if (nu_mode_twins == 0) {
+                add_mode_twins(0);
+                add_mode_twins(1);
+            }
+            argi++;
+            continue;
+        }
         if (strcasecmp(argv[argi], "--list") == 0) {
             printf("Tests (memcpy):\n");
             for (int i = 0; i < NU_TESTS; i++)
@@ -1027,11 +4842,9 @@ int main(int argc, char *argv[]) {
             for (int i = 0; i < NU_MEMSET_TESTS; i++)
                 printf("%3d    %s\n", i, memset_test[i].name);
             printf("memcpy variants:\n");
-            for (int i = 0; i < NU_MEMCPY_VARIANTS; i++)
-                printf("  %c    %s\n", memcpy_variant_to_char(i), memcpy_variant_name[i]);
+            list_variants(0);
             printf("memset variants:\n");
-            for (int i = 0; i < NU_MEMSET_VARIANTS; i++)
-                printf("  %c    %s\n", memcpy_variant_to_char(i), memset_variant_name[i]);
+            list_variants(1);
             return 0;
         }
         if (strcasecmp(argv[argi], "--help") == 0) {
@@ -1049,11 +4862,7 @@ int main(int argc, char *argv[]) {
             continue;
         }
         if (argi + 1 < argc && strcasecmp(argv[argi], "--memcpy") == 0) {
-            for (int i = 0; i < NU_MEMCPY_VARIANTS; i++)
-                memcpy_mask[i] = 0;
-            for (int i = 0; i < strlen(argv[argi + 1]); i++)
-                if (char_to_memcpy_variant(argv[argi + 1][i]) >= 0 && char_to_memcpy_variant(argv[argi + 1][i]) < NU_MEMCPY_VARIANTS)
-                    memcpy_mask[char_to_memcpy_variant(argv[argi + 1][i])] = 1;
+            select_variants(argv[argi + 1], memcpy_mask, nu_memcpy_variants);
             memcpy_specified = 1;
             argi += 2;
             continue;
@@ -1067,17 +4876,18 @@ int main(int argc, char *argv[]) {
             argi += 2;
             continue;
         }
+        if (argi + 1 < argc && strcasecmp(argv[argi], "--validate-exports") == 0) {
+            validate_exports = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
         if (strcasecmp(argv[argi], "--validate") == 0) {
             validate = 1;
             argi++;
             continue;
         }
         if (argi + 1 < argc && strcasecmp(argv[argi], "--memset") == 0) {
-            for (int i = 0; i < NU_MEMSET_VARIANTS; i++)
-                memset_mask[i] = 0;
-            for (int i = 0; i < strlen(argv[argi + 1]); i++)
-                if (char_to_memcpy_variant(argv[argi + 1][i]) >= 0 && char_to_memcpy_variant(argv[argi + 1][i]) < NU_MEMSET_VARIANTS)
-                    memset_mask[char_to_memcpy_variant(argv[argi + 1][i])] = 1;
+            select_variants(argv[argi + 1], memset_mask, nu_memset_variants);
             memset_specified = 1;
             argi += 2;
             continue;
@@ -1086,10 +4896,42 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    /*
+     * The other-mode encoding of a variant is selected along with the
+     * variant. Variants loaded with --load are always selected, and the
+     * tests of their kind are run (only --memcpy and --memset exclude each
+     * other).
+     */
+    for (int i = 0; i < nu_mode_twins; i++) {
+        if (mode_twin[i].is_memset)
+            memset_mask[mode_twin[i].variant] |= memset_mask[mode_twin[i].base];
+        else
+            memcpy_mask[mode_twin[i].variant] |= memcpy_mask[mode_twin[i].base];
+    }
+    int memcpy_loaded = 0;
+    int memset_loaded = 0;
+    for (int i = NU_BUILTIN_MEMCPY_VARIANTS; i < nu_memcpy_variants; i++)
+        if (!is_mode_twin(0, i)) {
+            memcpy_mask[i] = 1;
+            memcpy_loaded = 1;
+        }
+    for (int i = NU_BUILTIN_MEMSET_VARIANTS; i < nu_memset_variants; i++)
+        if (!is_mode_twin(1, i)) {
+            memset_mask[i] = 1;
+            memset_loaded = 1;
+        }
+
+    if (calibrated && cold_icache) {
+        printf("Specify only one of --calibrated and --cold-icache.\n");
+        return 1;
+    }
+
     if (memcpy_specified && memset_specified) {
         printf("Specify only one of --memcpy and --memset.\n");
         return 1;
     }
+    memcpy_specified |= memcpy_loaded;
+    memset_specified |= memset_loaded;
 
     if (command_test != -1 && memset_specified &&
     command_test >= NU_MEMSET_TESTS) {
@@ -1097,8 +4939,13 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    if ((command_test != -1) + command_all != 1 && !validate) {
-        printf("Specify only one of --test and --all.\n");
+    if ((command_test != -1) + command_all + command_async + command_batch + command_probe +
+    command_scenarios + command_pollution + command_diff + command_tests + command_sweep +
+    command_pattern + command_hint + command_aliasing + command_filecopy != 1 && !validate &&
+    validate_exports == NULL) {
+        printf("Specify only one of --test, --all, --tests, --async, --batch, --probe, "
+            "--scenarios, --pollution, --diff, --pattern, --hint, --aliasing, --filecopy and "
+            "--sweep.\n");
         return 1;
     }
 
@@ -1106,7 +4953,7 @@ int main(int argc, char *argv[]) {
     buffer_page = (uint8_t *)buffer_alloc + ((4096 - ((uintptr_t)buffer_alloc & 4095))
         & 4095);
     buffer_chunk = buffer_page + 17 * 32;
-    if (validate)
+    if (validate || validate_exports != NULL)
         buffer_compare = malloc(1024 * 1024 * 16);
     srand(0);
     random_buffer_1024 = malloc(sizeof(int) * RANDOM_BUFFER_SIZE);
@@ -1160,24 +5007,45 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    int start_test, end_test;
+    int start_test, end_test, end_memset_test;
     start_test = 0;
-    if (memset_specified)
-        end_test = NU_MEMSET_TESTS - 1;
-    else
-        end_test = NU_TESTS - 1;
+    end_test = NU_TESTS - 1;
+    end_memset_test = NU_MEMSET_TESTS - 1;
     if (command_test != - 1) {
         start_test = command_test;
         end_test = command_test;
+        end_memset_test = command_test;
+    }
+    if (!cpu_has_mp_extensions()) {
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && uses_pldw((const void *)memcpy_variant[j])) {
+                printf("Skipping %s: no multiprocessing extensions.\n", memcpy_variant_name[j]);
+                memcpy_mask[j] = 0;
+            }
+        for (int j = 0; j < nu_memset_variants; j++)
+            if (memset_mask[j] && uses_pldw((const void *)memset_variant[j])) {
+                printf("Skipping %s: no multiprocessing extensions.\n", memset_variant_name[j]);
+                memset_mask[j] = 0;
+            }
+    }
+    if (validate_exports != NULL)
+        return do_validation_exports(validate_exports) ? 0 : 1;
+    if (validate && command_pattern) {
+        do_validation_pattern(repeat);
+        return 0;
+    }
+    if (validate && command_hint) {
+        do_validation_hint(repeat);
+        return 0;
     }
     if (validate) {
-        for (int j = 0; j < NU_MEMCPY_VARIANTS; j++)
+        for (int j = 0; j < nu_memcpy_variants; j++)
             if (memcpy_mask[j]) {
                 printf("%s:\n", memcpy_variant_name[j]);
                 memcpy_func = memcpy_variant[j];
                 do_validation(repeat);
             }
-        for (int j = 0; j < NU_MEMSET_VARIANTS; j++)
+        for (int j = 0; j < nu_memset_variants; j++)
             if (memset_mask[j]) {
                 printf("%s:\n", memset_variant_name[j]);
                 memset_func = memset_variant[j];
@@ -1185,44 +5053,154 @@ int main(int argc, char *argv[]) {
             }
         return 0;
     }
-    if (!memcpy_specified)
-        goto skip_memcpy_test;
-    for (int t = start_test; t <= end_test; t++) {
-        for (int j = 0; j < NU_MEMCPY_VARIANTS; j++)
-            if (memcpy_mask[j]) {
+    if ((interleave || benchmark_cpu >= 0) && !setup_benchmark_cpu(force))
+        return 1;
+    if (command_probe) {
+        do_probe();
+        return 0;
+    }
+    /*
+     * The async, pollution, batch, diff, hint, aliasing and file copy modes
+     * copy with arbitrary alignments and sizes, so variants with an alignment
+     * contract are not run by them.
+     */
+    if (command_async) {
+        if (!memcpy_specified)
+            for (int j = 0; j < nu_memcpy_variants; j++)
+                memcpy_mask[j] = memcpy_variant[j] == memcpy_new_neon_line_size_32;
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
+                printf("%s:\n", memcpy_variant_name[j]);
+                memcpy_func = memcpy_variant[j];
+                do_async_tests(async_cpu);
+            }
+        return 0;
+    }
+    if (command_pollution) {
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
+                printf("%s:\n", memcpy_variant_name[j]);
+                memcpy_func = memcpy_variant[j];
+                do_pollution_tests();
+            }
+        return 0;
+    }
+    if (command_batch) {
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
+                printf("%s:\n", memcpy_variant_name[j]);
+                memcpy_func = memcpy_variant[j];
+                do_batch_tests();
+            }
+        return 0;
+    }
+    if (command_filecopy) {
+        if (!memcpy_specified)
+            for (int j = 0; j < nu_memcpy_variants; j++)
+                memcpy_mask[j] = memcpy_variant[j] == memcpy_new_neon_line_size_32;
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
+                printf("%s:\n", memcpy_variant_name[j]);
+                memcpy_func = memcpy_variant[j];
+                do_file_copy_tests();
+            }
+        return 0;
+    }
+    if (command_aliasing) {
+        if (!memcpy_specified)
+            for (int j = 0; j < nu_memcpy_variants; j++)
+                memcpy_mask[j] = memcpy_variant[j] == memcpy_new_neon_line_size_32;
+        do_aliasing_tests();
+        return 0;
+    }
+    if (command_sweep) {
+        do_sweeps(memcpy_specified, memset_specified);
+        return 0;
+    }
+    if (command_pattern) {
+        do_pattern_tests();
+        return 0;
+    }
+    if (command_hint) {
+        if (!memcpy_specified)
+            for (int j = 0; j < nu_memcpy_variants; j++)
+                memcpy_mask[j] = memcpy_variant[j] == memcpy_new_neon_line_size_32;
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
+                memcpy_func = memcpy_variant[j];
+                do_hint_tests(memcpy_variant_name[j]);
+            }
+        return 0;
+    }
+    if (command_diff) {
+        if (!memcpy_specified)
+            for (int j = 0; j < nu_memcpy_variants; j++)
+                memcpy_mask[j] = memcpy_variant[j] == memcpy_new_neon_line_size_32;
+        for (int j = 0; j < nu_memcpy_variants; j++)
+            if (memcpy_mask[j] && get_required_alignment((const void *)memcpy_variant[j]) == 0) {
                 printf("%s:\n", memcpy_variant_name[j]);
                 memcpy_func = memcpy_variant[j];
-                for (int i = 0; i < repeat; i++)
-                    do_test(test[t].name, test[t].test_func, test[t].bytes);
+                do_diff_tests();
             }
+        return 0;
+    }
+    if (roofline && !command_scenarios)
+        measure_roofline_peaks();
+    if (nu_noise_threads > 0) {
+        if (benchmark_cpu < 0) {
+            /* Keep the measurements on a fixed core, away from the noise. */
+            benchmark_cpu = 0;
+            setup_benchmark_cpu(1);
+        }
+        if (!start_noise_threads())
+            return 1;
+    }
+    if (command_scenarios) {
+        create_damage_rects();
+        for (int t = 0; t < NU_SCENARIOS; t++)
+            run_test(scenario[t].name, scenario[t].test_func, scenario[t].bytes,
+                scenario[t].alignment, 0, repeat,
+                do_scenario);
+        goto skip_memset_test;
+    }
+    if (command_tests) {
+        run_custom_tests(memcpy_specified, memset_specified, repeat);
+        goto skip_memset_test;
     }
+    if (!memcpy_specified)
+        goto skip_memcpy_test;
+    for (int t = start_test; t <= end_test; t++)
+        run_test(test[t].name, test[t].test_func, test[t].bytes, test[t].alignment, 0, repeat,
+            do_test);
 skip_memcpy_test:
     if (!memset_specified)
         goto skip_memset_test;
-    for (int t = start_test; t <= end_test; t++) {
+    for (int t = start_test; t <= end_memset_test; t++) {
         if (t == 11) {
             for (test_alignment = 0; test_alignment < 32; test_alignment += 4) {
                 char test_name[128];
                 sprintf(test_name, "%s (alignment %d)", memset_test[t].name,
                     test_alignment);
-                for (int j = 0; j < NU_MEMSET_VARIANTS; j++)
-                    if (memset_mask[j]) {
-                        printf("%s:\n", memset_variant_name[j]);
-                        memset_func = memset_variant[j];
-                        for (int i = 0; i < repeat; i++)
-                            do_test(test_name, memset_test[t].test_func, memset_test[t].bytes);
-                    }
+                run_test(test_name, memset_test[t].test_func, memset_test[t].bytes,
+                    memset_test[t].alignment, 1, repeat, do_test);
             }
             continue;
         }
-        for (int j = 0; j < NU_MEMSET_VARIANTS; j++)
-            if (memset_mask[j]) {
-                printf("%s:\n", memset_variant_name[j]);
-                memset_func = memset_variant[j];
-                for (int i = 0; i < repeat; i++)
-                    do_test(memset_test[t].name, memset_test[t].test_func, memset_test[t].bytes);
-            }
+        run_test(memset_test[t].name, memset_test[t].test_func, memset_test[t].bytes,
+            memset_test[t].alignment, 1, repeat, do_test);
     }
 skip_memset_test:
+    if (nu_noise_threads > 0)
+        stop_noise_threads();
+    if (save_baseline != NULL && !save_results(&current_results, save_baseline))
+        return 1;
+    if (compare_baseline != NULL) {
+        result_set_t baseline = { 0, 0, NULL };
+        if (!load_results(&baseline, compare_baseline))
+            return 1;
+        if (compare_results(&baseline, &current_results, regression_threshold,
+        regression_significance) > 0)
+            return 2;
+    }
     exit(0);
 }
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2013 Harm Hanemaaijer <fgenfb@yahoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+#include "file_copy.h"
+
+/* Size of each mapping of the source file. */
+#define FILE_COPY_MAP_SIZE (4 * 1024 * 1024)
+/*
+ * Size of the windows copied at a time. A window is about the size of the
+ * L2 cache, so that the source pages of a window are released while the
+ * next chunk of the mapping is still being copied.
+ */
+#define FILE_COPY_WINDOW_SIZE (256 * 1024)
+/* Size of the sendfile() requests and of the buffer of the read() fallback. */
+#define FILE_COPY_CHUNK_SIZE (1024 * 1024)
+
+static fastarm_memcpy_func_type file_copy_func = memcpy;
+
+void fastarm_copy_file_set_func(fastarm_memcpy_func_type copy_func) {
+    file_copy_func = copy_func != NULL ? copy_func : memcpy;
+}
+
+/*
+ * Read up to n bytes into dest, at offset or from the current position when
+ * offset is negative. Returns the number of bytes read, or -1 when nothing
+ * could be read because of an error.
+ */
+static ssize_t read_all(int fd, uint8_t *dest, size_t n, off_t offset) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = offset >= 0 ? pread(fd, dest + done, n - done, offset + done) :
+            read(fd, dest + done, n - done);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return done > 0 ? (ssize_t)done : - 1;
+        }
+        if (r == 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+/* Write n bytes from src, at offset or at the current position when negative. */
+static int write_all(int fd, const uint8_t *src, size_t n, off_t offset) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = offset >= 0 ? pwrite(fd, src + done, n - done, offset + done) :
+            write(fd, src + done, n - done);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return - 1;
+        }
+        done += r;
+    }
+    return 0;
+}
+
+/*
+ * Copy n bytes at in_offset of the regular file fd_in, which must lie within
+ * the file, through mappings of the source. The data is copied to dest, or
+ * written to fd_out at out_offset when dest is NULL. Returns the number of
+ * bytes copied, or -1 when nothing was copied because of an error.
+ */
+static ssize_t copy_mapped(int fd_in, off_t in_offset, uint8_t *dest, int fd_out,
+off_t out_offset, size_t n) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t done = 0;
+    posix_fadvise(fd_in, in_offset, n, POSIX_FADV_SEQUENTIAL);
+    while (done < n) {
+        off_t pos = in_offset + done;
+        off_t map_offset = pos & ~(off_t)(page_size - 1);
+        size_t delta = pos - map_offset;
+        size_t chunk = n - done;
+        if (chunk > FILE_COPY_MAP_SIZE - delta)
+            chunk = FILE_COPY_MAP_SIZE - delta;
+        uint8_t *map = mmap(NULL, delta + chunk, PROT_READ, MAP_SHARED | MAP_POPULATE, fd_in,
+            map_offset);
+        if (map == MAP_FAILED)
+            return done > 0 ? (ssize_t)done : - 1;
+        uint8_t *released = map;
+        for (size_t w = 0; w < chunk; w += FILE_COPY_WINDOW_SIZE) {
+            size_t size = chunk - w < FILE_COPY_WINDOW_SIZE ? chunk - w : FILE_COPY_WINDOW_SIZE;
+            if (dest != NULL)
+                file_copy_func(dest + done + w, map + delta + w, size);
+            else if (write_all(fd_out, map + delta + w, size,
+            out_offset >= 0 ? out_offset + (off_t)(done + w) : - 1) != 0) {
+                munmap(map, delta + chunk);
+                return done + w > 0 ? (ssize_t)(done + w) : - 1;
+            }
+            /* Release the source pages that have been copied completely. */
+            uint8_t *end = map + ((delta + w + size) & ~(page_size - 1));
+            if (end > released) {
+                madvise(released, end - released, MADV_DONTNEED);
+                released = end;
+            }
+        }
+        munmap(map, delta + chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+/* Copy through a buffer with read() and write(). */
+static ssize_t copy_buffered(int fd_in, off_t in_offset, int fd_out, off_t out_offset,
+size_t n) {
+    uint8_t *buffer = malloc(FILE_COPY_CHUNK_SIZE);
+    if (buffer == NULL)
+        return - 1;
+    size_t done = 0;
+    while (done < n) {
+        size_t size = n - done < FILE_COPY_CHUNK_SIZE ? n - done : FILE_COPY_CHUNK_SIZE;
+        ssize_t r = read_all(fd_in, buffer, size, in_offset >= 0 ? in_offset + (off_t)done : - 1);
+        if (r == 0)
+            break;
+        if (r < 0 || write_all(fd_out, buffer, r,
+        out_offset >= 0 ? out_offset + (off_t)done : - 1) != 0) {
+            free(buffer);
+            return done > 0 ? (ssize_t)done : - 1;
+        }
+        done += r;
+        if ((size_t)r < size)
+            break;
+    }
+    free(buffer);
+    return done;
+}
+
+/*
+ * Copy between regular files in the kernel. Returns the number of bytes
+ * copied, or -1 when nothing was copied, with errno set to ENOSYS or EINVAL
+ * when neither method is supported for these files.
+ */
+static ssize_t copy_in_kernel(int fd_in, off_t in_offset, int fd_out, off_t out_offset,
+size_t n) {
+    size_t done = 0;
+#ifdef SYS_copy_file_range
+    loff_t in_pos = in_offset;
+    loff_t out_pos = out_offset;
+    while (done < n) {
+        ssize_t r = syscall(SYS_copy_file_range, fd_in, &in_pos, fd_out, &out_pos, n - done, 0);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (r == 0)
+            return done;
+        done += r;
+    }
+    if (done == n)
+        return done;
+    /* EBADF is also returned for an output opened with O_APPEND. */
+    if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP &&
+    errno != EBADF)
+        return done > 0 ? (ssize_t)done : - 1;
+#endif
+    /* sendfile() writes at the file position of the output. */
+    off_t in_pos_sendfile = in_offset + done;
+    if (lseek(fd_out, out_offset + done, SEEK_SET) < 0)
+        return done > 0 ? (ssize_t)done : - 1;
+    while (done < n) {
+        size_t size = n - done < FILE_COPY_CHUNK_SIZE ? n - done : FILE_COPY_CHUNK_SIZE;
+        ssize_t r = sendfile(fd_out, fd_in, &in_pos_sendfile, size);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return done > 0 ? (ssize_t)done : - 1;
+        }
+        if (r == 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+ssize_t fastarm_copy_file_to_buffer(void *dest, int fd_in, off_t in_offset, size_t n) {
+    struct stat st;
+    if (fstat(fd_in, &st) != 0)
+        return - 1;
+    if (!S_ISREG(st.st_mode))
+        return read_all(fd_in, dest, n, - 1);
+    if (in_offset >= st.st_size)
+        return 0;
+    if (n > (size_t)(st.st_size - in_offset))
+        n = st.st_size - in_offset;
+    ssize_t r = copy_mapped(fd_in, in_offset, dest, - 1, - 1, n);
+    if (r < 0 && errno == ENODEV)
+        /* The file system does not support mappings. */
+        return read_all(fd_in, dest, n, in_offset);
+    return r;
+}
+
+ssize_t fastarm_copy_file_range(int fd_in, off_t in_offset, int fd_out, off_t out_offset,
+size_t n) {
+    struct stat st_in, st_out;
+    if (fstat(fd_in, &st_in) != 0 || fstat(fd_out, &st_out) != 0)
+        return - 1;
+    if (!S_ISREG(st_out.st_mode))
+        out_offset = - 1;
+    if (!S_ISREG(st_in.st_mode))
+        return copy_buffered(fd_in, - 1, fd_out, out_offset, n);
+    if (in_offset >= st_in.st_size)
+        return 0;
+    if (n > (size_t)(st_in.st_size - in_offset))
+        n = st_in.st_size - in_offset;
+    if (S_ISREG(st_out.st_mode)) {
+        ssize_t r = copy_in_kernel(fd_in, in_offset, fd_out, out_offset, n);
+        if (r >= 0 || (errno != ENOSYS && errno != EINVAL))
+            return r;
+    }
+    ssize_t r = copy_mapped(fd_in, in_offset, NULL, fd_out, out_offset, n);
+    if (r < 0 && errno == ENODEV)
+        return copy_buffered(fd_in, in_offset, fd_out, out_offset, n);
+    return r;
+}
@@ -0,0 +1,48 @@
+/*
+ * File copies through mapped windows.
+ *
+ * The source file is mapped in chunks (MAP_POPULATE, after advising
+ * sequential read-ahead with posix_fadvise) and copied in windows of about
+ * the size of the L2 cache by the memcpy implementation, releasing each
+ * window of the mapping behind the copy with MADV_DONTNEED. This avoids the extra copy through a user space buffer made
+ * by read(). When both sides are regular files, the copy is left to the
+ * kernel with copy_file_range() or sendfile().
+ */
+
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifndef FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+#define FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+typedef void *(*fastarm_memcpy_func_type)(void *dest, const void *src, size_t n);
+#endif
+
+/*
+ * Copy n bytes starting at offset in_offset of the file fd_in to dest.
+ * Returns the number of bytes copied, which is less than n when the end of
+ * the file is reached, or -1 with errno set on error. When fd_in is not a
+ * regular file, it is read with read() from its current position.
+ */
+extern ssize_t fastarm_copy_file_to_buffer(void *dest, int fd_in, off_t in_offset, size_t n);
+
+/*
+ * Copy n bytes starting at offset in_offset of fd_in to offset out_offset of
+ * fd_out. Returns the number of bytes copied, which is less than n when the
+ * end of the source file is reached, or -1 with errno set on error. The file
+ * position of fd_out may be changed. A side that is not a regular file (a
+ * pipe or socket) is read or written at its current position instead, and
+ * is copied through a buffer.
+ */
+extern ssize_t fastarm_copy_file_range(int fd_in, off_t in_offset, int fd_out, off_t out_offset,
+    size_t n);
+
+/*
+ * Set the memcpy implementation used to copy from the mapped source. The
+ * default is memcpy.
+ */
+extern void fastarm_copy_file_set_func(fastarm_memcpy_func_type copy_func);
+
+#endif
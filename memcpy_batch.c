@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Harm Hanemaaijer <fgenfb@yahoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "memcpy_batch.h"
+
+/*
+ * Copies up to this size are performed inline instead of calling the
+ * memcpy implementation.
+ */
+#define BATCH_SMALL_SIZE 64
+/* Number of descriptors that are grouped by alignment class at a time. */
+#define BATCH_CHUNK_SIZE 64
+/* Number of descriptors to look ahead when preloading source data. */
+#define BATCH_PRELOAD_AHEAD 2
+/* Maximum number of source bytes preloaded for each upcoming descriptor. */
+#define BATCH_PRELOAD_BYTES 128
+#define BATCH_PRELOAD_LINE_SIZE 32
+
+/*
+ * Prevent the compiler from turning the inline copy loops back into calls
+ * to memcpy.
+ */
+#define NO_MEMCPY_CALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+enum {
+    CLASS_WORD_ALIGNED_SMALL,
+    CLASS_UNALIGNED_SMALL,
+    CLASS_LARGE,
+    NU_CLASSES
+};
+
+static fastarm_memcpy_func_type batch_copy_func = memcpy;
+
+void fastarm_memcpy_batch_set_func(fastarm_memcpy_func_type copy_func) {
+    batch_copy_func = copy_func != NULL ? copy_func : memcpy;
+}
+
+static inline int alignment_class(void *dest, const void *src, size_t n) {
+    if (n > BATCH_SMALL_SIZE)
+        return CLASS_LARGE;
+    if ((((uintptr_t)dest | (uintptr_t)src | n) & 3) == 0)
+        return CLASS_WORD_ALIGNED_SMALL;
+    return CLASS_UNALIGNED_SMALL;
+}
+
+static inline void preload_source(const void *src, size_t n) {
+    uintptr_t p = (uintptr_t)src & ~(uintptr_t)(BATCH_PRELOAD_LINE_SIZE - 1);
+    uintptr_t end = (uintptr_t)src + (n < BATCH_PRELOAD_BYTES ? n : BATCH_PRELOAD_BYTES);
+    for (; p < end; p += BATCH_PRELOAD_LINE_SIZE)
+        __builtin_prefetch((const void *)p);
+}
+
+static inline uint32_t load_unaligned(const uint8_t *p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void store_unaligned(uint8_t *p, uint32_t v) {
+    __builtin_memcpy(p, &v, 4);
+}
+
+/* Copy a multiple of four bytes up to BATCH_SMALL_SIZE, word aligned. */
+static inline NO_MEMCPY_CALLS void copy_small_word_aligned(void *dest, const void *src,
+size_t n) {
+    uint32_t *d = dest;
+    const uint32_t *s = src;
+    for (; n >= 8; n -= 8) {
+        uint32_t v0 = s[0];
+        uint32_t v1 = s[1];
+        s += 2;
+        d[0] = v0;
+        d[1] = v1;
+        d += 2;
+    }
+    if (n != 0)
+        *d = *s;
+}
+
+/*
+ * Copy up to BATCH_SMALL_SIZE bytes with any alignment. The last word is
+ * copied with an overlapping unaligned access instead of a byte tail.
+ */
+static inline NO_MEMCPY_CALLS void copy_small_unaligned(void *dest, const void *src,
+size_t n) {
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    if (n < 4) {
+        if (n & 2) {
+            uint8_t v0 = s[0];
+            uint8_t v1 = s[1];
+            d[0] = v0;
+            d[1] = v1;
+            d += 2;
+            s += 2;
+        }
+        if (n & 1)
+            *d = *s;
+        return;
+    }
+    uint32_t last = load_unaligned(s + n - 4);
+    for (size_t i = 0; i + 4 < n; i += 4)
+        store_unaligned(d + i, load_unaligned(s + i));
+    store_unaligned(d + n - 4, last);
+}
+
+static inline void copy_one(int c, void *dest, const void *src, size_t n) {
+    if (c == CLASS_WORD_ALIGNED_SMALL)
+        copy_small_word_aligned(dest, src, n);
+    else if (c == CLASS_UNALIGNED_SMALL)
+        copy_small_unaligned(dest, src, n);
+    else
+        batch_copy_func(dest, src, n);
+}
+
+/*
+ * Copy the descriptors with the given indices, which all belong to the
+ * alignment class c, preloading the source of upcoming descriptors.
+ */
+static inline void copy_class(int c, const struct fastarm_copy_desc *d,
+const uint8_t *index, int count) {
+    for (int k = 0; k < BATCH_PRELOAD_AHEAD && k < count; k++)
+        preload_source(d[index[k]].src, d[index[k]].n);
+    for (int k = 0; k < count; k++) {
+        if (k + BATCH_PRELOAD_AHEAD < count) {
+            const struct fastarm_copy_desc *next = &d[index[k + BATCH_PRELOAD_AHEAD]];
+            preload_source(next->src, next->n);
+        }
+        const struct fastarm_copy_desc *e = &d[index[k]];
+        copy_one(c, e->dest, e->src, e->n);
+    }
+}
+
+void fastarm_memcpy_batch(const struct fastarm_copy_desc *d, size_t n) {
+    uint8_t index[NU_CLASSES][BATCH_CHUNK_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_CHUNK_SIZE) {
+        const struct fastarm_copy_desc *chunk = d + base;
+        int count = n - base < BATCH_CHUNK_SIZE ? n - base : BATCH_CHUNK_SIZE;
+        int class_count[NU_CLASSES] = { 0, 0, 0 };
+        for (int i = 0; i < count; i++) {
+            int c = alignment_class(chunk[i].dest, chunk[i].src, chunk[i].n);
+            index[c][class_count[c]++] = i;
+        }
+        /* Do the large copies first, they include their own early preloads. */
+        copy_class(CLASS_LARGE, chunk, index[CLASS_LARGE], class_count[CLASS_LARGE]);
+        copy_class(CLASS_WORD_ALIGNED_SMALL, chunk, index[CLASS_WORD_ALIGNED_SMALL],
+            class_count[CLASS_WORD_ALIGNED_SMALL]);
+        copy_class(CLASS_UNALIGNED_SMALL, chunk, index[CLASS_UNALIGNED_SMALL],
+            class_count[CLASS_UNALIGNED_SMALL]);
+    }
+}
+
+size_t fastarm_memcpy_gather(void *dest, const struct iovec *iov, int iovcnt) {
+    uint8_t *d = dest;
+    for (int i = 0; i < BATCH_PRELOAD_AHEAD && i < iovcnt; i++)
+        preload_source(iov[i].iov_base, iov[i].iov_len);
+    for (int i = 0; i < iovcnt; i++) {
+        if (i + BATCH_PRELOAD_AHEAD < iovcnt)
+            preload_source(iov[i + BATCH_PRELOAD_AHEAD].iov_base,
+                iov[i + BATCH_PRELOAD_AHEAD].iov_len);
+        size_t n = iov[i].iov_len;
+        copy_one(alignment_class(d, iov[i].iov_base, n), d, iov[i].iov_base, n);
+        d += n;
+    }
+    return d - (uint8_t *)dest;
+}
+
+size_t fastarm_memcpy_scatter(const struct iovec *iov, int iovcnt, const void *src) {
+    const uint8_t *s = src;
+    preload_source(s, BATCH_PRELOAD_BYTES);
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n = iov[i].iov_len;
+        if (i + 1 < iovcnt)
+            preload_source(s + n, BATCH_PRELOAD_BYTES);
+        copy_one(alignment_class(iov[i].iov_base, s, n), iov[i].iov_base, s, n);
+        s += n;
+    }
+    return s - (const uint8_t *)src;
+}
@@ -0,0 +1,48 @@
+/*
+ * Batched memcpy and scatter/gather copies.
+ *
+ * The descriptors of a batch must be independent: no destination region may
+ * overlap the source or destination region of another descriptor in the same
+ * batch, because descriptors are grouped by alignment class and are not
+ * necessarily copied in order.
+ */
+
+#ifndef MEMCPY_BATCH_H
+#define MEMCPY_BATCH_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifndef FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+#define FASTARM_MEMCPY_FUNC_TYPE_DEFINED
+typedef void *(*fastarm_memcpy_func_type)(void *dest, const void *src, size_t n);
+#endif
+
+struct fastarm_copy_desc {
+    void *dest;
+    const void *src;
+    size_t n;
+};
+
+/* Perform the n copies described by d. */
+extern void fastarm_memcpy_batch(const struct fastarm_copy_desc *d, size_t n);
+
+/*
+ * Gather the iovcnt buffers described by iov into the contiguous destination.
+ * Returns the number of bytes copied.
+ */
+extern size_t fastarm_memcpy_gather(void *dest, const struct iovec *iov, int iovcnt);
+
+/*
+ * Scatter the contiguous source into the iovcnt buffers described by iov.
+ * Returns the number of bytes copied.
+ */
+extern size_t fastarm_memcpy_scatter(const struct iovec *iov, int iovcnt, const void *src);
+
+/*
+ * Set the memcpy implementation used for copies larger than the batch small
+ * size threshold. The default is memcpy.
+ */
+extern void fastarm_memcpy_batch_set_func(fastarm_memcpy_func_type copy_func);
+
+#endif
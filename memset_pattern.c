@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Harm Hanemaaijer <fgenfb@yahoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "new_arm.h"
+
+/*
+ * Patterns of other lengths than 1, 2, 4 or 8 bytes are written once and then
+ * extended by copying the already filled part of the destination, doubling
+ * the copied chunk up to about this size so that the source of each copy
+ * stays in the cache.
+ */
+#define PATTERN_MAX_CHUNK_SIZE 4096
+
+void *fastarm_memset_pattern(void *dest, const void *pattern, size_t pattern_len,
+size_t n) {
+    const uint8_t *p = pattern;
+    uint8_t *d = dest;
+    if (pattern_len == 1)
+        return memset(dest, p[0], n);
+    /* Patterns of 2 and 4 bytes are replicated to 8 bytes. */
+    if (pattern_len == 2 || pattern_len == 4 || pattern_len == 8) {
+        uint64_t v = 0;
+        int i;
+        for (i = 0; i < 8; i++)
+            v |= (uint64_t)p[i & (pattern_len - 1)] << (i * 8);
+        return fastarm_memset_pattern64(dest, n, v);
+    }
+    if (pattern_len == 0 || n == 0)
+        return dest;
+    size_t filled = pattern_len < n ? pattern_len : n;
+    memcpy(d, p, filled);
+    /* The largest chunk is a multiple of the pattern length. */
+    size_t max_chunk = PATTERN_MAX_CHUNK_SIZE - PATTERN_MAX_CHUNK_SIZE % pattern_len;
+    if (max_chunk == 0)
+        max_chunk = pattern_len;
+    while (filled < n) {
+        size_t chunk = filled < max_chunk ? filled : max_chunk;
+        if (chunk > n - filled)
+            chunk = n - filled;
+        memcpy(d + filled, d, chunk);
+        filled += chunk;
+    }
+    return dest;
+}
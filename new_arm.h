@@ -20,12 +20,34 @@ extern void *memcpy_new_line_size_32_preload_96(void *dest,
 extern void *memcpy_new_line_size_32_preload_96_aligned_access(void *dest,
     const void *src, size_t n);
 
+extern void *memcpy_new_line_size_64_preload_192_jump_table(void *dest,
+    const void *src, size_t n);
+
+extern void *memcpy_new_line_size_32_preload_192_jump_table(void *dest,
+    const void *src, size_t n);
+
+extern void *memcpy_new_line_size_32_preload_96_jump_table(void *dest,
+    const void *src, size_t n);
+
+extern void *memcpy_new_line_size_32_preload_96_aligned_access_jump_table(void *dest,
+    const void *src, size_t n);
+
+extern void *memcpy_new_line_size_64_preload_192_pldw_128(void *dest,
+    const void *src, size_t n);
+
+extern void *memcpy_new_line_size_32_preload_192_pldw_128(void *dest,
+    const void *src, size_t n);
+
 extern void *memcpy_new_neon_line_size_64(void *dest, const void *src, size_t n);
 
 extern void *memcpy_new_neon_line_size_32(void *dest, const void *src, size_t n);
 
 extern void *memcpy_new_neon_line_size_32_auto(void *dest, const void *src, size_t n);
 
+extern void *memcpy_new_neon_line_size_64_pldw_128(void *dest, const void *src, size_t n);
+
+extern void *memcpy_new_neon_line_size_32_pldw_128(void *dest, const void *src, size_t n);
+
 extern void *memset_new_align_0(void *dest, int c, size_t size);
 
 extern void *memset_new_align_8(void *dest, int c, size_t size);
@@ -33,3 +55,102 @@ extern void *memset_new_align_8(void *dest, int c, size_t size);
 extern void *memset_new_align_32(void *dest, int c, size_t size);
 
 extern void *memset_neon(void *dest, int c, size_t size);
+
+extern void *memset_new_align_32_pldw_128(void *dest, int c, size_t size);
+
+extern void *memset_neon_pldw_128(void *dest, int c, size_t size);
+
+/*
+ * Streaming kernels used by the benchmark to measure peak bandwidth. The size
+ * must be a non-zero multiple of 64 and the buffers 16-byte aligned.
+ */
+
+extern void stream_read_neon(const void *src, size_t n);
+
+extern void stream_read_ldm(const void *src, size_t n);
+
+extern void stream_write_neon(void *dest, size_t n);
+
+extern void stream_write_stm(void *dest, size_t n);
+
+extern void stream_copy_neon(void *dest, const void *src, size_t n);
+
+extern void stream_copy_ldm(void *dest, const void *src, size_t n);
+
+/*
+ * Alignment contract entry points. The source and destination must be aligned
+ * to 16, 32 or 64 bytes respectively and the size must be a multiple of 16.
+ * When libfastarm is built with -DFASTARM_DEBUG, a violation of the contract
+ * aborts the program.
+ */
+
+extern void *fastarm_memcpy_aligned16(void *dest, const void *src, size_t n);
+
+extern void *fastarm_memcpy_aligned32(void *dest, const void *src, size_t n);
+
+extern void *fastarm_memcpy_aligned64(void *dest, const void *src, size_t n);
+
+extern void *fastarm_memset_aligned16(void *dest, int c, size_t size);
+
+extern void *fastarm_memset_aligned32(void *dest, int c, size_t size);
+
+extern void *fastarm_memset_aligned64(void *dest, int c, size_t size);
+
+/*
+ * Differential copy. Only the lines of FASTARM_MEMCPY_DIFF_LINE_SIZE bytes
+ * that differ between source and destination are written. Bit i of bitmap is
+ * set when line i was written and cleared otherwise; the bitmap must have
+ * room for FASTARM_MEMCPY_DIFF_BITMAP_WORDS(n) words. Returns the number of
+ * written lines.
+ */
+
+#define FASTARM_MEMCPY_DIFF_LINE_SIZE 32
+#define FASTARM_MEMCPY_DIFF_BITMAP_WORDS(n) \
+    (((n) + FASTARM_MEMCPY_DIFF_LINE_SIZE * 32 - 1) / (FASTARM_MEMCPY_DIFF_LINE_SIZE * 32))
+
+extern int fastarm_memcpy_diff(void *dest, const void *src, size_t n, unsigned int *bitmap);
+
+/*
+ * Wide pattern fills. The destination may have any alignment. count is the
+ * number of 16, 32 or 64-bit elements; the value is stored in native (little)
+ * endian byte order. fastarm_memset_pattern64 fills n bytes with the
+ * repeating 8-byte pattern, storing a partial pattern at the end when n is
+ * not a multiple of 8. fastarm_memset_pattern (memset_pattern.c) fills n
+ * bytes with copies of a pattern of any length.
+ */
+
+extern void *fastarm_memset16(void *dest, unsigned short value, size_t count);
+
+extern void *fastarm_memset32(void *dest, unsigned int value, size_t count);
+
+extern void *fastarm_memset64(void *dest, unsigned long long value, size_t count);
+
+extern void *fastarm_memset_pattern64(void *dest, size_t n, unsigned long long pattern);
+
+extern void *fastarm_memset_pattern(void *dest, const void *pattern, size_t pattern_len,
+    size_t n);
+
+/*
+ * Copy with locality hints. flags is a preload distance (the distance the
+ * source is preloaded ahead) combined with hints about the use of the
+ * buffers after the copy, and selects a specialized variant:
+ * - FASTARM_HINT_PRELOAD_NEAR for a source in L2, FASTARM_HINT_PRELOAD_FAR
+ *   for a source in DRAM with a long latency, FASTARM_HINT_PRELOAD_NONE to
+ *   rely on the automatic prefetcher, or none of these for the default.
+ * - FASTARM_HINT_DEST_READ_SOON when the destination is read soon after the
+ *   copy, which keeps it cache-hot (write preloads). Otherwise it is
+ *   streamed. The write preloads (PLDW) require the multiprocessing
+ *   extensions (Cortex-A5/A7/A9/A12/A15/A17), so this flag must only be
+ *   passed on such cores. It is ignored on the Raspberry Pi platform.
+ * - FASTARM_HINT_SRC_NO_REUSE when the source is not accessed again
+ *   (currently no effect).
+ */
+
+#define FASTARM_HINT_PRELOAD_NEAR 1
+#define FASTARM_HINT_PRELOAD_FAR 2
+#define FASTARM_HINT_PRELOAD_NONE 3
+#define FASTARM_HINT_PRELOAD_MASK 3
+#define FASTARM_HINT_DEST_READ_SOON 4
+#define FASTARM_HINT_SRC_NO_REUSE 8
+
+extern void *fastarm_memcpy_hint(void *dest, const void *src, size_t n, unsigned int flags);